@@ -54,14 +54,22 @@
 #define UTIL_WEIGHT .60
 
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes (either 4 or 8, 16 for 64-bit builds) 
  */
+#ifdef __LP64__
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8  
+#endif
 
 /* 
  * Maximum heap size in bytes 
  */
+#ifdef __LP64__
+#define MAX_HEAP ((size_t)4 << 30)  /* 4 GB */
+#else
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
+#endif
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
@@ -15,6 +15,8 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -29,9 +31,13 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MAX_REGIONS 16   /* regions a trace can use */
+#define MAX_POOLS 16     /* pools a trace can use */
+#define THREAD_OPS 200000 /* each thread replays a trace until it did this many ops */
+#define RING_SIZE  256    /* blocks in flight between a producer and its consumer */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -46,9 +52,14 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC, BALLOC, BFREE, SFREE, MEMALIGN, CALLOC,
+	  RALLOC, RRESET, PGET, PPUT} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
+    int size;                         /* byte size of alloc/realloc request, or
+                                         what a sized free passes (the last one) */
+    int count;                        /* ids index.. of a batch request or region reset */
+    int align;                        /* alignment of a memalign or pool request */
+    int region;                       /* region or pool of a region or pool request */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -60,6 +71,8 @@ typedef struct {
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    size_t *block_caps;  /* ... and what they can hold (mm_usable_size, -u) */
+    mm_handle_t *handles; /* ... and their handles when they are movable (-H) */
 } trace_t;
 
 /* 
@@ -81,6 +94,10 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    mm_counts_t counts; /* splits/merges while measuring util */
+    int skipped;        /* reallocs -u didn't have to make while measuring util */
+    size_t peak_heap;   /* most heap + mapped bytes while measuring util */
+    size_t final_heap;  /* heap + mapped bytes left when the trace is done */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -90,6 +107,17 @@ typedef struct {
  *******************/
 int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
+static int unbatch = 0; /* replay batch requests one block at a time (-b) */
+static int sized = 0;   /* replay every free as a sized free (-s) */
+static int calloc_memset = 0; /* replay callocs as mm_malloc and memset (-c) */
+static int capacity = 0; /* skip reallocs that fit in mm_usable_size (-u) */
+static int skipped = 0;  /* reallocs the last util run skipped that way */
+static int unregion = 0; /* replay region requests as mm_malloc and mm_free (-r) */
+static mm_region_t *regions[MAX_REGIONS]; /* regions of the trace that runs now */
+static int unpool = 0;   /* replay pool requests as mm_malloc and mm_free (-o) */
+static mm_pool_t *pools[MAX_POOLS]; /* pools of the trace that runs now */
+static int movable = 0;  /* replay mallocs, reallocs and frees with handles (-H) */
+static int checking = 0; /* mm_check_touched after every request of the correctness run (-C) */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -121,16 +149,35 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
+static int batch_malloc(traceop_t *op, char **blocks);
+static void batch_free(traceop_t *op, char **blocks);
+static char *region_alloc(traceop_t *op, mm_region_t **regs);
+static void region_reset(traceop_t *op, char **blocks, mm_region_t **regs);
+static void region_drop(mm_region_t **regs);
+static char *pool_get(traceop_t *op, mm_pool_t **pls);
+static void pool_put(traceop_t *op, char *p, mm_pool_t **pls);
+static void pool_drop(mm_pool_t **pls);
+static int handle_replay(trace_t *trace, int tracenum, int check, int *max_total);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_threads(trace_t *trace, char *name, int max_threads);
+static void *replay_thread(void *ptr);
+static double run_threads(trace_t *trace, int n, int narenas, int reps);
+static void eval_mm_pipes(trace_t *trace, char *name, int npairs);
+static void *producer_thread(void *ptr);
+static void *consumer_thread(void *ptr);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcounts(int n, stats_t *stats);
+static void printheap(int n, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
+static int parse_policy(char *arg);
+static int parse_growth(char *arg);
 
 /**************
  * Main routine
@@ -150,6 +197,13 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    char *policy = NULL; /* If set, placement policy for mm.c (-p) */
+    int max_threads = 0; /* If set, run the scaling test up to this many threads (-T) */
+    int max_pairs = 0;   /* If set, run the producer/consumer test with this many pairs (-P) */
+    int defer = 0;       /* If set, defer coalescing in mm.c (-d) */
+    char *mmap_min = NULL; /* If set, mmap threshold for mm.c (-m) */
+    char *growth = NULL; /* If set, heap growth steps for mm.c (-G) */
+    int fresh = 0;       /* If set, every run starts on a zero heap (-z) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +212,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:p:T:P:m:G:bcdorsuzhvVgalHC")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +238,59 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'p': /* Placement policy for mm.c */
+            policy = optarg;
+            break;
+        case 'b': /* Batch requests as single mm_malloc/mm_free calls */
+            unbatch = 1;
+            break;
+        case 'o': /* Pool requests as mm_malloc and mm_free */
+            unpool = 1;
+            break;
+        case 'H': /* Movable blocks instead of mm_malloc and mm_free */
+            movable = 1;
+            break;
+        case 'C': /* Check the heap after every request */
+            checking = 1;
+            break;
+        case 'r': /* Region requests as mm_malloc and mm_free */
+            unregion = 1;
+            break;
+        case 's': /* Frees as mm_free_sized */
+            sized = 1;
+            break;
+        case 'c': /* Callocs as mm_malloc and memset */
+            calloc_memset = 1;
+            break;
+        case 'u': /* Skip reallocs that fit in mm_usable_size */
+            capacity = 1;
+            break;
+        case 'z': /* Give the heap back between runs */
+            fresh = 1;
+            break;
+        case 'd': /* Deferred coalescing in mm.c */
+            defer = 1;
+            break;
+        case 'm': /* Threshold for huge blocks in mm.c */
+            mmap_min = optarg;
+            break;
+        case 'G': /* Heap growth steps in mm.c */
+            growth = optarg;
+            break;
+        case 'T': /* Multi-threaded scaling test */
+            max_threads = atoi(optarg);
+            if (max_threads < 1) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'P': /* Producer/consumer remote free test */
+            max_pairs = atoi(optarg);
+            if (max_pairs < 1) {
+                usage();
+                exit(1);
+            }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -294,6 +401,26 @@ int main(int argc, char **argv)
     
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
+    if (fresh)
+	mem_fresh_heaps(1);
+
+    /* Select the placement policy before any trace runs */
+    if (policy != NULL) {
+	if (parse_policy(policy) < 0) {
+	    printf("ERROR: placement policy \"%s\" is not available\n", policy);
+	    exit(1);
+	}
+	if (verbose > 1)
+	    printf("Placement policy: %s\n", policy);
+    }
+    if (defer)
+	mm_set_deferred(1);
+    if (mmap_min != NULL)
+	mm_set_mmap_threshold(strtoul(mmap_min, NULL, 0));
+    if (growth != NULL && parse_growth(growth) < 0) {
+	printf("ERROR: heap growth \"%s\" is not min[:max[:ramp]]\n", growth);
+	exit(1);
+    }
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
@@ -306,6 +433,10 @@ int main(int argc, char **argv)
 	    if (verbose > 1)
 		printf("efficiency, ");
 	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    mm_get_counts(&mm_stats[i].counts);
+	    mm_stats[i].skipped = skipped;
+	    mm_stats[i].peak_heap = mem_peaksize();
+	    mm_stats[i].final_heap = mem_heapsize() + mem_hheapsize() + mem_mapsize();
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
@@ -320,6 +451,34 @@ int main(int argc, char **argv)
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
+	printcounts(num_tracefiles, mm_stats);
+	printf("\n");
+	printheap(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* Optionally see how the mm package scales with threads */
+    if (max_threads > 0 && errors == 0) {
+	printf("\nThread scaling for mm malloc:\n");
+	printf("%-20s%8s%8s%10s%10s%9s\n", "trace", "threads", "arenas", "secs", "Kops", "speedup");
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    eval_mm_threads(trace, tracefiles[i], max_threads);
+	    free_trace(trace);
+	}
+	printf("\n");
+    }
+
+    /* Optionally see how fast blocks can be freed by another thread */
+    if (max_pairs > 0 && errors == 0) {
+	printf("\nProducer/consumer for mm malloc (%d blocks per pair):\n", THREAD_OPS);
+	printf("%-20s%8s%8s%10s%10s\n", "trace", "pairs", "arenas", "secs", "Kops");
+	for (i=0; i < num_tracefiles; i++) {
+	    trace = read_trace(tracedir, tracefiles[i]);
+	    eval_mm_pipes(trace, tracefiles[i], max_pairs);
+	    free_trace(trace);
+	}
+	printf("\n");
     }
 
     /* 
@@ -403,10 +562,12 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
-	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
+    /* The payload must lie within the extent of the heap, or within
+     * one of the regions mm.c mapped for huge blocks */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
+	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p) and mapped regions",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
         return 0;
@@ -476,6 +637,20 @@ static void clear_ranges(range_t **ranges)
  * The following routines manipulate tracefiles
  *********************************************/
 
+/*
+ * check_ids - Bail out if ids first..first+n-1 are not all below
+ *     num_ids, before read_trace indexes last[] with them
+ */
+static void check_ids(unsigned first, unsigned n, trace_t *trace, char *path)
+{
+    if (first >= (unsigned)trace->num_ids ||
+	n > (unsigned)trace->num_ids - first) {
+	sprintf(msg, "Id %u in tracefile %s is not below %d",
+		first + (n > 0 ? n - 1 : 0), path, trace->num_ids);
+	app_error(msg);
+    }
+}
+
 /*
  * read_trace - read a trace file and store it in memory
  */
@@ -485,9 +660,10 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, count, align, region;
     unsigned max_index = 0;
     unsigned op_index;
+    int *last;              /* size each id was last given, for sized frees */
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -522,6 +698,14 @@ static trace_t *read_trace(char *tracedir, char *filename)
     if ((trace->block_sizes = 
 	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
 	unix_error("malloc 4 failed in read_trace");
+    if ((trace->block_caps = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 5 failed in read_trace");
+    if ((trace->handles = 
+	 (mm_handle_t *)malloc(trace->num_ids * sizeof(mm_handle_t))) == NULL)
+	unix_error("malloc 6 failed in read_trace");
+    if ((last = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+	unix_error("calloc 7 failed in read_trace");
     
     /* read every request line in the trace file */
     index = 0;
@@ -530,22 +714,117 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	switch(type[0]) {
 	case 'a':
 	    fscanf(tracefile, "%u %u", &index, &size);
+	    check_ids(index, 1, trace, path);
 	    trace->ops[op_index].type = ALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    last[index] = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'r':
 	    fscanf(tracefile, "%u %u", &index, &size);
+	    check_ids(index, 1, trace, path);
 	    trace->ops[op_index].type = REALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    last[index] = size;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'f':
 	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
+	    check_ids(index, 1, trace, path);
+	    trace->ops[op_index].type = sized ? SFREE : FREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = last[index];
+	    break;
+	case 's': /* s id - free with the size id was last given */
+	    fscanf(tracefile, "%u", &index);
+	    check_ids(index, 1, trace, path);
+	    trace->ops[op_index].type = SFREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = last[index];
+	    break;
+	case 'm': /* m id align size - memalign */
+	    fscanf(tracefile, "%u %u %u", &index, &align, &size);
+	    check_ids(index, 1, trace, path);
+	    trace->ops[op_index].type = MEMALIGN;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].align = align;
+	    trace->ops[op_index].size = size;
+	    last[index] = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'c': /* c id size - calloc */
+	    fscanf(tracefile, "%u %u", &index, &size);
+	    check_ids(index, 1, trace, path);
+	    trace->ops[op_index].type = CALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    last[index] = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'A': /* A first n size - alloc ids first..first+n-1 in one batch */
+	    fscanf(tracefile, "%u %u %u", &index, &count, &size);
+	    check_ids(index, count, trace, path);
+	    trace->ops[op_index].type = BALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    trace->ops[op_index].size = size;
+	    while (count-- > 0)
+		last[index++] = size;
+	    index--;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'F': /* F first n - free ids first..first+n-1 in one batch */
+	    fscanf(tracefile, "%u %u", &index, &count);
+	    check_ids(index, count, trace, path);
+	    trace->ops[op_index].type = BFREE;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].count = count;
+	    break;
+	case 'g': /* g region id size - alloc id from a region */
+	case 'x': /* x region first n - reset a region, ids first..first+n-1 die */
+	    fscanf(tracefile, "%u %u %u", &region, &index, &size);
+	    if (region >= MAX_REGIONS) {
+		printf("Region %u in tracefile %s is not below %d\n",
+		       region, path, MAX_REGIONS);
+		exit(1);
+	    }
+	    trace->ops[op_index].region = region;
 	    trace->ops[op_index].index = index;
+	    if (type[0] == 'x') {
+		trace->ops[op_index].type = RRESET;
+		trace->ops[op_index].count = size;
+		break;
+	    }
+	    check_ids(index, 1, trace, path);
+	    trace->ops[op_index].type = RALLOC;
+	    trace->ops[op_index].size = size;
+	    last[index] = size;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'o': /* o pool id size align - get id from a pool */
+	case 'q': /* q pool id - put id back */
+	    fscanf(tracefile, "%u %u", &region, &index);
+	    if (region >= MAX_POOLS) {
+		printf("Pool %u in tracefile %s is not below %d\n",
+		       region, path, MAX_POOLS);
+		exit(1);
+	    }
+	    check_ids(index, 1, trace, path);
+	    trace->ops[op_index].region = region;
+	    trace->ops[op_index].index = index;
+	    if (type[0] == 'q') {
+		trace->ops[op_index].type = PPUT;
+		trace->ops[op_index].size = last[index];
+		break;
+	    }
+	    fscanf(tracefile, "%u %u", &size, &align);
+	    trace->ops[op_index].type = PGET;
+	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].align = align;
+	    last[index] = size;
+	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
@@ -556,6 +835,7 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	
     }
     fclose(tracefile);
+    free(last);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
     
@@ -563,14 +843,16 @@ static trace_t *read_trace(char *tracedir, char *filename)
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
+ * free_trace - Free the trace record and the five arrays it points
  *              to, all of which were allocated in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    free(trace->ops);         /* free the five arrays... */
     free(trace->blocks);      
     free(trace->block_sizes);
+    free(trace->block_caps);
+    free(trace->handles);
     free(trace);              /* and the trace record itself... */
 }
 
@@ -579,15 +861,272 @@ void free_trace(trace_t *trace)
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * batch_malloc - Carry out a batch alloc request, blocks index.. of it
+ *     go to blocks[]. One mm_malloc_batch, or one mm_malloc per block
+ *     with -b so the two can be timed against each other.
+ *     Returns 0 if mm.c ran out of memory.
+ */
+static int batch_malloc(traceop_t *op, char **blocks)
+{
+    int i;
+
+    if (!unbatch)
+	return mm_malloc_batch(op->size, op->count, (void **)&blocks[op->index]) == op->count;
+    for (i = op->index; i < op->index + op->count; i++)
+	if ((blocks[i] = mm_malloc(op->size)) == NULL)
+	    return 0;
+    return 1;
+}
+
+/*
+ * batch_free - Carry out a batch free request. mm_free_batch sorts the
+ *     pointers, that is fine since the ids are dead after this anyway.
+ *     The ids are set to NULL.
+ */
+static void batch_free(traceop_t *op, char **blocks)
+{
+    int i;
+
+    if (!unbatch)
+	mm_free_batch((void **)&blocks[op->index], op->count);
+    for (i = op->index; i < op->index + op->count; i++) {
+	if (unbatch)
+	    mm_free(blocks[i]);
+	blocks[i] = NULL;
+    }
+}
+
+/*
+ * region_alloc - Carry out a region alloc request with mm_region_alloc,
+ *     the region is made the first time the trace uses it. -r makes it a
+ *     plain mm_malloc so the two can be timed against each other.
+ *     Returns NULL if mm.c ran out of memory.
+ */
+static char *region_alloc(traceop_t *op, mm_region_t **regs)
+{
+    if (unregion)
+	return mm_malloc(op->size);
+    if (regs[op->region] == NULL &&
+	(regs[op->region] = mm_region_create(0)) == NULL)
+	return NULL;
+    return mm_region_alloc(regs[op->region], op->size);
+}
+
+/*
+ * region_reset - Carry out a region reset request, with -r one mm_free
+ *     per id instead. The ids are set to NULL.
+ */
+static void region_reset(traceop_t *op, char **blocks, mm_region_t **regs)
+{
+    int i;
+
+    for (i = op->index; i < op->index + op->count; i++) {
+	if (unregion)
+	    mm_free(blocks[i]);
+	blocks[i] = NULL;
+    }
+    if (!unregion && regs[op->region] != NULL)
+	mm_region_reset(regs[op->region]);
+}
+
+/*
+ * region_drop - Destroy the regions a replay made with all that is in them
+ */
+static void region_drop(mm_region_t **regs)
+{
+    int i;
+
+    for (i = 0; i < MAX_REGIONS; i++) {
+	mm_region_destroy(regs[i]);
+	regs[i] = NULL;
+    }
+}
+
+/*
+ * pool_get - Carry out a pool get request with mm_pool_get, the pool is
+ *     made with the size and alignment of the first get from it. -o makes
+ *     it an mm_malloc (mm_memalign for a bigger alignment) instead.
+ *     Returns NULL if mm.c ran out of memory.
+ */
+static char *pool_get(traceop_t *op, mm_pool_t **pls)
+{
+    if (unpool)
+	return op->align > ALIGNMENT ? mm_memalign(op->align, op->size) : mm_malloc(op->size);
+    if (pls[op->region] == NULL &&
+	(pls[op->region] = mm_pool_create(op->size, op->align)) == NULL)
+	return NULL;
+    return mm_pool_get(pls[op->region]);
+}
+
+/*
+ * pool_put - Carry out a pool put request, with -o an mm_free
+ */
+static void pool_put(traceop_t *op, char *p, mm_pool_t **pls)
+{
+    if (unpool)
+	mm_free(p);
+    else
+	mm_pool_put(pls[op->region], p);
+}
+
+/*
+ * pool_drop - Destroy the pools a replay made with all that is in them
+ */
+static void pool_drop(mm_pool_t **pls)
+{
+    int i;
+
+    for (i = 0; i < MAX_POOLS; i++) {
+	mm_pool_destroy(pls[i]);
+	pls[i] = NULL;
+    }
+}
+
+/*
+ * handle_replay - Replay a trace with movable blocks (-H): a malloc is an
+ *     mm_halloc, a realloc an mm_halloc, a copy and an mm_hfree of the old
+ *     handle, a free an mm_hfree. Blocks move between requests, so with
+ *     check every block is filled with the low byte of its id and checked
+ *     to still hold it when it is realloced or freed, instead of keeping
+ *     ranges. max_total, if not NULL, gets the most payload bytes in use.
+ *     Returns 0 on an error (reported with check, fatal otherwise).
+ */
+static int handle_replay(trace_t *trace, int tracenum, int check, int *max_total)
+{
+    int i, j, index, size, oldsize;
+    int total = 0;
+    mm_handle_t h;
+    char *p, *oldp;
+    char *lo = mem_hheap_lo();
+
+    for (i = 0; i < trace->num_ops; i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+	switch (trace->ops[i].type) {
+
+	case ALLOC:   /* mm_halloc */
+	case REALLOC: /* mm_halloc, copy, mm_hfree */
+	    if ((h = mm_halloc(size)) == 0) {
+		if (!check)
+		    app_error("mm_halloc failed");
+		malloc_error(tracenum, i, "mm_halloc failed.");
+		return 0;
+	    }
+	    p = mm_hlock(h);
+	    if (check && (!IS_ALIGNED(p) || p < lo || p + size > lo + mem_hheapsize())) {
+		malloc_error(tracenum, i, "mm_hlock returned a block outside the movable heap.");
+		return 0;
+	    }
+	    oldsize = 0;
+	    if (trace->ops[i].type == REALLOC) {
+		oldp = mm_hlock(trace->handles[index]);
+		oldsize = trace->block_sizes[index];
+		for (j = 0; check && j < oldsize; j++) {
+		    if (oldp[j] != (char)(index & 0xFF)) {
+			malloc_error(tracenum, i, "movable block lost its data");
+			return 0;
+		    }
+		}
+		if (size < oldsize) oldsize = size;
+		memcpy(p, oldp, oldsize);
+		mm_hunlock(trace->handles[index]);
+		mm_hfree(trace->handles[index]);
+		total -= trace->block_sizes[index];
+	    }
+	    if (check)
+		memset(p + oldsize, index & 0xFF, size - oldsize);
+	    mm_hunlock(h);
+	    trace->handles[index] = h;
+	    trace->block_sizes[index] = size;
+	    total += size;
+	    if (max_total != NULL && total > *max_total)
+		*max_total = total;
+	    break;
+
+	case FREE:  /* mm_hfree */
+	case SFREE:
+	    if (check) {
+		p = mm_hlock(trace->handles[index]);
+		for (j = 0; j < (int)trace->block_sizes[index]; j++) {
+		    if (p[j] != (char)(index & 0xFF)) {
+			malloc_error(tracenum, i, "movable block lost its data");
+			return 0;
+		    }
+		}
+		mm_hunlock(trace->handles[index]);
+	    }
+	    mm_hfree(trace->handles[index]);
+	    total -= trace->block_sizes[index];
+	    break;
+
+	default:
+	    app_error("-H only replays mallocs, reallocs and frees");
+	}
+
+	if (check && checking && !mm_check_touched()) {
+	    malloc_error(tracenum, i, "mm_check_touched found the heap broken.");
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ * calloc_block - Carry out a calloc request with mm_calloc, or with -c
+ *     with mm_malloc and a memset so the two can be timed against each
+ *     other. Returns NULL if mm.c ran out of memory.
+ */
+static char *calloc_block(int size)
+{
+    char *p;
+
+    if (!calloc_memset)
+	return mm_calloc(1, size);
+    if ((p = mm_malloc(size)) != NULL)
+	memset(p, 0, size);
+    return p;
+}
+
+/*
+ * note_cap - With -u remember what mm_usable_size says block index can
+ *     hold, a realloc that fits in that is skipped
+ */
+static void note_cap(trace_t *trace, int index, char *p)
+{
+    if (capacity)
+	trace->block_caps[index] = mm_usable_size(p);
+}
+
+/*
+ * valid_cap - note_cap for eval_mm_valid, which checks and fills what a
+ *     block can hold, not just its size. That is the size without -u.
+ *     Returns 0 if mm_usable_size is less than the size.
+ */
+static int valid_cap(trace_t *trace, int index, char *p, int size,
+		     int tracenum, int opnum)
+{
+    trace->block_caps[index] = size;
+    note_cap(trace, index, p);
+    if (trace->block_caps[index] < (size_t)size) {
+	malloc_error(tracenum, opnum, "mm_usable_size is less than the size asked for.");
+	return 0;
+    }
+    return (int)trace->block_caps[index];
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
+    int i, j, k;
     int index;
     int size;
     int oldsize;
+    int cap;
+    size_t actual;
     char *newp;
     char *oldp;
     char *p;
@@ -595,12 +1134,16 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
     clear_ranges(ranges);
+    memset(regions, 0, sizeof(regions));
+    memset(pools, 0, sizeof(pools));
 
     /* Call the mm package's init function */
     if (mm_init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
+    if (movable)
+	return handle_replay(trace, tracenum, 1, NULL);
 
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -612,17 +1155,25 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    p = capacity ? mm_malloc_sized(size, &actual) : mm_malloc(size);
+	    if (p == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
+	    if ((cap = valid_cap(trace, index, p, size, tracenum, i)) == 0)
+		return 0;
+	    if (capacity && actual != (size_t)cap) {
+		malloc_error(tracenum, i, "mm_malloc_sized and mm_usable_size disagree.");
+		return 0;
+	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
 	     * to the range list if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
+	     * With -u all of what it can hold has to be free for us.
 	     */ 
-	    if (add_range(ranges, p, size, tracenum, i) == 0)
+	    if (add_range(ranges, p, cap, tracenum, i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -630,7 +1181,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * if we realloc the block and wish to make sure that the old
 	     * data was copied to the new block
 	     */
-	    memset(p, index & 0xFF, size);
+	    memset(p, index & 0xFF, cap);
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
@@ -639,6 +1190,12 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case REALLOC: /* mm_realloc */
 	    
+	    /* With -u the block grows (or shrinks) in what it holds */
+	    if (capacity && (size_t)size <= trace->block_caps[index]) {
+		trace->block_sizes[index] = size;
+		break;
+	    }
+
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
 	    if ((newp = mm_realloc(oldp, size)) == NULL) {
@@ -650,7 +1207,9 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    remove_range(ranges, oldp);
 	    
 	    /* Check new block for correctness and add it to range list */
-	    if (add_range(ranges, newp, size, tracenum, i) == 0)
+	    if ((cap = valid_cap(trace, index, newp, size, tracenum, i)) == 0)
+		return 0;
+	    if (add_range(ranges, newp, cap, tracenum, i) == 0)
 		return 0;
 	    
 	    /* ADDED: cgw
@@ -661,13 +1220,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if (newp[j] != (char)(index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
 	      }
 	    }
-	    memset(newp, index & 0xFF, size);
+	    memset(newp, index & 0xFF, cap);
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
@@ -682,11 +1241,138 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    mm_free(p);
 	    break;
 
+        case SFREE: /* mm_free_sized */
+	    p = trace->blocks[index];
+	    remove_range(ranges, p);
+	    mm_free_sized(p, size);
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+	    if ((p = mm_memalign(trace->ops[i].align, size)) == NULL) {
+		malloc_error(tracenum, i, "mm_memalign failed.");
+		return 0;
+	    }
+	    if ((size_t)p % trace->ops[i].align != 0) {
+		malloc_error(tracenum, i, "mm_memalign returned a misaligned payload.");
+		return 0;
+	    }
+	    if ((cap = valid_cap(trace, index, p, size, tracenum, i)) == 0)
+		return 0;
+	    if (add_range(ranges, p, cap, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, cap);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case CALLOC: /* mm_calloc */
+	    if ((p = calloc_block(size)) == NULL) {
+		malloc_error(tracenum, i, "mm_calloc failed.");
+		return 0;
+	    }
+	    if ((cap = valid_cap(trace, index, p, size, tracenum, i)) == 0)
+		return 0;
+	    if (add_range(ranges, p, cap, tracenum, i) == 0)
+		return 0;
+	    for (j = 0; j < size; j++) {
+		if (p[j] != 0) {
+		    malloc_error(tracenum, i, "mm_calloc returned memory that is not zero.");
+		    return 0;
+		}
+	    }
+	    memset(p, index & 0xFF, cap);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case BALLOC: /* mm_malloc_batch */
+	    if (!batch_malloc(&trace->ops[i], trace->blocks)) {
+		malloc_error(tracenum, i, "mm_malloc_batch failed.");
+		return 0;
+	    }
+	    for (j = index; j < index + trace->ops[i].count; j++) {
+		p = trace->blocks[j];
+		if ((cap = valid_cap(trace, j, p, size, tracenum, i)) == 0)
+		    return 0;
+		if (add_range(ranges, p, cap, tracenum, i) == 0)
+		    return 0;
+		memset(p, j & 0xFF, cap);
+		trace->block_sizes[j] = size;
+	    }
+	    break;
+
+        case BFREE: /* mm_free_batch */
+	    for (j = index; j < index + trace->ops[i].count; j++)
+		remove_range(ranges, trace->blocks[j]);
+	    batch_free(&trace->ops[i], trace->blocks);
+	    break;
+
+        case RALLOC: /* mm_region_alloc */
+	    if ((p = region_alloc(&trace->ops[i], regions)) == NULL) {
+		malloc_error(tracenum, i, "mm_region_alloc failed.");
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case RRESET: /* mm_region_reset */
+	    /* nothing else in the region may have written over its objects */
+	    for (j = index; j < index + trace->ops[i].count; j++) {
+		p = trace->blocks[j];
+		for (k = 0; k < (int)trace->block_sizes[j]; k++) {
+		    if (p[k] != (char)(j & 0xFF)) {
+			malloc_error(tracenum, i, "mm_region_alloc objects overlap.");
+			return 0;
+		    }
+		}
+		remove_range(ranges, p);
+	    }
+	    region_reset(&trace->ops[i], trace->blocks, regions);
+	    break;
+
+        case PGET: /* mm_pool_get */
+	    if ((p = pool_get(&trace->ops[i], pools)) == NULL) {
+		malloc_error(tracenum, i, "mm_pool_get failed.");
+		return 0;
+	    }
+	    if ((size_t)p % trace->ops[i].align != 0) {
+		malloc_error(tracenum, i, "mm_pool_get returned a misaligned object.");
+		return 0;
+	    }
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    break;
+
+        case PPUT: /* mm_pool_put */
+	    p = trace->blocks[index];
+	    for (j = 0; j < size; j++) {
+		if (p[j] != (char)(index & 0xFF)) {
+		    malloc_error(tracenum, i, "mm_pool_get objects overlap.");
+		    return 0;
+		}
+	    }
+	    remove_range(ranges, p);
+	    pool_put(&trace->ops[i], p, pools);
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 
+	if (checking && !mm_check_touched()) {
+	    malloc_error(tracenum, i, "mm_check_touched found the heap broken.");
+	    return 0;
+	}
     }
+    region_drop(regions);
+    pool_drop(pools);
 
     /* As far as we know, this is a valid malloc package */
     return 1;
@@ -705,7 +1391,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {   
-    int i;
+    int i, j;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
@@ -717,6 +1403,13 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
     mem_reset_brk();
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
+    skipped = 0;
+    memset(regions, 0, sizeof(regions));
+    memset(pools, 0, sizeof(pools));
+    if (movable) {
+	handle_replay(trace, tracenum, 0, &max_total_size);
+	return ((double)max_total_size / (double)mem_peaksize());
+    }
 
     for (i = 0;  i < trace->num_ops;  i++) {
         switch (trace->ops[i].type) {
@@ -725,7 +1418,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    p = capacity ? mm_malloc_sized(size, &trace->block_caps[index]) : mm_malloc(size);
+	    if (p == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -746,12 +1440,19 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    newsize = trace->ops[i].size;
 	    oldsize = trace->block_sizes[index];
 
-	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc failed in eval_mm_util");
+	    /* with -u a block that can hold newsize is left alone */
+	    if (capacity && (size_t)newsize <= trace->block_caps[index]) {
+		skipped++;
+	    }
+	    else {
+		oldp = trace->blocks[index];
+		if ((newp = mm_realloc(oldp,newsize)) == NULL)
+		    app_error("mm_realloc failed in eval_mm_util");
+		trace->blocks[index] = newp;
+		note_cap(trace, index, newp);
+	    }
 
 	    /* Remember region and size */
-	    trace->blocks[index] = newp;
 	    trace->block_sizes[index] = newsize;
 	    
 	    /* Keep track of current total size
@@ -776,13 +1477,106 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+        case SFREE: /* mm_free_sized */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    mm_free_sized(trace->blocks[index], size);
+	    total_size -= size;
+	    break;
+
+        case MEMALIGN: /* mm_memalign */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = mm_memalign(trace->ops[i].align, size)) == NULL)
+		app_error("mm_memalign failed in eval_mm_util");
+	    note_cap(trace, index, p);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case CALLOC: /* mm_calloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = calloc_block(size)) == NULL)
+		app_error("mm_calloc failed in eval_mm_util");
+	    note_cap(trace, index, p);
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case BALLOC: /* mm_malloc_batch */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if (!batch_malloc(&trace->ops[i], trace->blocks))
+		app_error("mm_malloc_batch failed in eval_mm_util");
+	    for (j = index; j < index + trace->ops[i].count; j++) {
+		trace->block_sizes[j] = size;
+		note_cap(trace, j, trace->blocks[j]);
+	    }
+	    total_size += size * trace->ops[i].count;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case BFREE: /* mm_free_batch */
+	    index = trace->ops[i].index;
+	    for (j = index; j < index + trace->ops[i].count; j++)
+		total_size -= trace->block_sizes[j];
+	    batch_free(&trace->ops[i], trace->blocks);
+	    break;
+
+        case RALLOC: /* mm_region_alloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = region_alloc(&trace->ops[i], regions)) == NULL)
+		app_error("mm_region_alloc failed in eval_mm_util");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case RRESET: /* mm_region_reset */
+	    index = trace->ops[i].index;
+	    for (j = index; j < index + trace->ops[i].count; j++)
+		total_size -= trace->block_sizes[j];
+	    region_reset(&trace->ops[i], trace->blocks, regions);
+	    break;
+
+        case PGET: /* mm_pool_get */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if ((p = pool_get(&trace->ops[i], pools)) == NULL)
+		app_error("mm_pool_get failed in eval_mm_util");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+        case PPUT: /* mm_pool_put */
+	    index = trace->ops[i].index;
+	    pool_put(&trace->ops[i], trace->blocks[index], pools);
+	    total_size -= trace->block_sizes[index];
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    /* mapped regions count as much as the heap, at the moment the two
+     * together were biggest */
+    return ((double)max_total_size / (double)mem_peaksize());
 }
 
 
@@ -792,7 +1586,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, j, index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -800,6 +1594,12 @@ static void eval_mm_speed(void *ptr)
     mem_reset_brk();
     if (mm_init() < 0) 
 	app_error("mm_init failed in eval_mm_speed");
+    memset(regions, 0, sizeof(regions));
+    memset(pools, 0, sizeof(pools));
+    if (movable) {
+	handle_replay(trace, 0, 0, NULL);
+	return;
+    }
 
     /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++)
@@ -808,7 +1608,8 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            p = capacity ? mm_malloc_sized(size, &trace->block_caps[index]) : mm_malloc(size);
+            if (p == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -816,10 +1617,13 @@ static void eval_mm_speed(void *ptr)
 	case REALLOC: /* mm_realloc */
 	    index = trace->ops[i].index;
             newsize = trace->ops[i].size;
+            if (capacity && (size_t)newsize <= trace->block_caps[index])
+                break;
 	    oldp = trace->blocks[index];
             if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
+            note_cap(trace, index, newp);
             break;
 
         case FREE: /* mm_free */
@@ -828,11 +1632,389 @@ static void eval_mm_speed(void *ptr)
             mm_free(block);
             break;
 
+        case SFREE: /* mm_free_sized */
+            index = trace->ops[i].index;
+            mm_free_sized(trace->blocks[index], trace->ops[i].size);
+            break;
+
+        case MEMALIGN: /* mm_memalign */
+            index = trace->ops[i].index;
+            if ((p = mm_memalign(trace->ops[i].align, trace->ops[i].size)) == NULL)
+		app_error("mm_memalign error in eval_mm_speed");
+            trace->blocks[index] = p;
+            note_cap(trace, index, p);
+            break;
+
+        case CALLOC: /* mm_calloc */
+            index = trace->ops[i].index;
+            if ((p = calloc_block(trace->ops[i].size)) == NULL)
+		app_error("mm_calloc error in eval_mm_speed");
+            trace->blocks[index] = p;
+            note_cap(trace, index, p);
+            break;
+
+        case BALLOC: /* mm_malloc_batch */
+            if (!batch_malloc(&trace->ops[i], trace->blocks))
+		app_error("mm_malloc_batch error in eval_mm_speed");
+            for (j = trace->ops[i].index; j < trace->ops[i].index + trace->ops[i].count; j++)
+                note_cap(trace, j, trace->blocks[j]);
+            break;
+
+        case BFREE: /* mm_free_batch */
+            batch_free(&trace->ops[i], trace->blocks);
+            break;
+
+        case RALLOC: /* mm_region_alloc */
+            if ((p = region_alloc(&trace->ops[i], regions)) == NULL)
+		app_error("mm_region_alloc error in eval_mm_speed");
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        case RRESET: /* mm_region_reset */
+            region_reset(&trace->ops[i], trace->blocks, regions);
+            break;
+
+        case PGET: /* mm_pool_get */
+            if ((p = pool_get(&trace->ops[i], pools)) == NULL)
+		app_error("mm_pool_get error in eval_mm_speed");
+            trace->blocks[trace->ops[i].index] = p;
+            break;
+
+        case PPUT: /* mm_pool_put */
+            pool_put(&trace->ops[i], trace->blocks[trace->ops[i].index], pools);
+            break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_valid");
         }
 }
 
+/* Holds the params to one replay_thread */
+typedef struct {
+    trace_t *trace;             /* trace to replay */
+    int reps;                   /* how many times to replay it */
+    pthread_barrier_t *start;   /* all threads and main start together */
+    int failed;                 /* set if the mm package ran out of memory */
+} thread_arg_t;
+
+/*
+ * replay_thread - Replays a trace reps times with its own block array,
+ *    anything the trace leaves allocated is freed after every round so
+ *    the threads don't run the heap dry.
+ */
+static void *replay_thread(void *ptr)
+{
+    thread_arg_t *arg = ptr;
+    trace_t *trace = arg->trace;
+    char **blocks;
+    char *p;
+    int i, r, index;
+    mm_region_t *regs[MAX_REGIONS] = { NULL };
+    mm_pool_t *pls[MAX_POOLS] = { NULL };
+
+    if ((blocks = calloc(trace->num_ids, sizeof(char *))) == NULL)
+	unix_error("calloc in replay_thread failed");
+    pthread_barrier_wait(arg->start);
+
+    for (r = 0; r < arg->reps && !arg->failed; r++) {
+	for (i = 0; i < trace->num_ops; i++) {
+	    index = trace->ops[i].index;
+	    switch (trace->ops[i].type) {
+	    case ALLOC:
+		if ((p = mm_malloc(trace->ops[i].size)) == NULL) {
+		    arg->failed = 1;
+		    i = trace->num_ops;
+		    break;
+		}
+		blocks[index] = p;
+		break;
+	    case REALLOC:
+		if ((p = mm_realloc(blocks[index], trace->ops[i].size)) == NULL) {
+		    arg->failed = 1;
+		    i = trace->num_ops;
+		    break;
+		}
+		blocks[index] = p;
+		break;
+	    case FREE:
+		mm_free(blocks[index]);
+		blocks[index] = NULL;
+		break;
+	    case SFREE:
+		mm_free_sized(blocks[index], trace->ops[i].size);
+		blocks[index] = NULL;
+		break;
+	    case MEMALIGN:
+		if ((p = mm_memalign(trace->ops[i].align, trace->ops[i].size)) == NULL) {
+		    arg->failed = 1;
+		    i = trace->num_ops;
+		    break;
+		}
+		blocks[index] = p;
+		break;
+	    case CALLOC:
+		if ((p = calloc_block(trace->ops[i].size)) == NULL) {
+		    arg->failed = 1;
+		    i = trace->num_ops;
+		    break;
+		}
+		blocks[index] = p;
+		break;
+	    case BALLOC:
+		if (!batch_malloc(&trace->ops[i], blocks)) {
+		    arg->failed = 1;
+		    i = trace->num_ops;
+		}
+		break;
+	    case BFREE:
+		batch_free(&trace->ops[i], blocks);
+		break;
+	    case RALLOC:
+		if ((p = region_alloc(&trace->ops[i], regs)) == NULL) {
+		    arg->failed = 1;
+		    i = trace->num_ops;
+		    break;
+		}
+		/* what is left in a region goes with the region */
+		if (unregion)
+		    blocks[index] = p;
+		break;
+	    case RRESET:
+		region_reset(&trace->ops[i], blocks, regs);
+		break;
+	    case PGET:
+		if ((p = pool_get(&trace->ops[i], pls)) == NULL) {
+		    arg->failed = 1;
+		    i = trace->num_ops;
+		    break;
+		}
+		blocks[index] = p;
+		break;
+	    case PPUT:
+		pool_put(&trace->ops[i], blocks[index], pls);
+		blocks[index] = NULL;
+		break;
+	    default:
+		app_error("Nonexistent request type in replay_thread");
+	    }
+	}
+	/* objects still out of a pool go with the pool */
+	for (i = 0; i < trace->num_ops && !unpool; i++)
+	    if (trace->ops[i].type == PGET)
+		blocks[trace->ops[i].index] = NULL;
+	for (i = 0; i < trace->num_ids; i++) {
+	    mm_free(blocks[i]);
+	    blocks[i] = NULL;
+	}
+	region_drop(regs);
+	pool_drop(pls);
+    }
+    free(blocks);
+    return NULL;
+}
+
+/*
+ * run_threads - Replays a trace on n threads at once on a fresh heap
+ *    with narenas arenas and returns the secs it took, or -1 if the mm
+ *    package ran out of memory.
+ */
+static double run_threads(trace_t *trace, int n, int narenas, int reps)
+{
+    int i, failed = 0;
+    struct timespec t0, t1;
+    pthread_t *tids;
+    thread_arg_t *args;
+    pthread_barrier_t start;
+
+    tids = malloc(n * sizeof(pthread_t));
+    args = malloc(n * sizeof(thread_arg_t));
+    if (tids == NULL || args == NULL)
+	unix_error("malloc in run_threads failed");
+
+    mm_set_arenas(narenas);
+    mem_reset_brk();
+    if (mm_init() < 0)
+	app_error("mm_init failed in run_threads");
+    pthread_barrier_init(&start, NULL, n + 1);
+    for (i = 0; i < n; i++) {
+	args[i].trace = trace;
+	args[i].reps = reps;
+	args[i].start = &start;
+	args[i].failed = 0;
+	if (pthread_create(&tids[i], NULL, replay_thread, &args[i]) != 0)
+	    unix_error("pthread_create in run_threads failed");
+    }
+    pthread_barrier_wait(&start);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < n; i++) {
+	pthread_join(tids[i], NULL);
+	failed |= args[i].failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    pthread_barrier_destroy(&start);
+    mm_set_arenas(1);
+    free(tids);
+    free(args);
+
+    if (failed)
+	return -1;
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+/*
+ * eval_mm_threads - Runs a trace on 1 up to max_threads threads at once
+ *    and prints the throughput of each run next to the one of a single
+ *    thread. Every thread count is run with one arena and with an arena
+ *    per thread (as many as the mm package has).
+ */
+static void eval_mm_threads(trace_t *trace, char *name, int max_threads)
+{
+    int n, k, narenas;
+    double secs, kops, base = 0;
+    int reps = THREAD_OPS / trace->num_ops;
+
+    if (reps < 1)
+	reps = 1;
+    for (n = 1; n <= max_threads; n++) {
+	for (k = 0; k < 2; k++) {
+	    narenas = k ? n : 1;
+	    if (k && (n == 1 || mm_set_arenas(narenas) < 0))
+		continue;
+	    if ((secs = run_threads(trace, n, narenas, reps)) < 0) {
+		printf("%-20s%8d%8d%10s%10s%9s\n", name, n, narenas, "-", "-", "no mem");
+		continue;
+	    }
+	    kops = (double)trace->num_ops * reps * n / secs / 1e3;
+	    if (n == 1)
+		base = kops;
+	    printf("%-20s%8d%8d%10.6f%10.0f%8.2fx\n", name, n, narenas, secs, kops,
+		   base > 0 ? kops / base : 0.0);
+	}
+    }
+}
+
+/* One producer/consumer pair, the producer mallocs and the consumer frees */
+typedef struct {
+    int *sizes;                 /* the producer cycles through these sizes */
+    int nsizes;
+    char *ring[RING_SIZE];      /* blocks on their way to the consumer */
+    unsigned head;              /* next slot the producer fills */
+    unsigned tail;              /* next slot the consumer empties */
+    pthread_barrier_t *start;   /* all threads and main start together */
+    int failed;                 /* set if the mm package ran out of memory */
+} pipe_t;
+
+/*
+ * producer_thread - mallocs THREAD_OPS blocks and hands them to the
+ *    consumer, waiting when the ring is full. A failed malloc still
+ *    sends a NULL so the consumer doesn't wait forever.
+ */
+static void *producer_thread(void *ptr)
+{
+    pipe_t *pp = ptr;
+    unsigned i;
+    char *p;
+
+    pthread_barrier_wait(pp->start);
+    for (i = 0; i < THREAD_OPS; i++) {
+	if ((p = mm_malloc(pp->sizes[i % pp->nsizes])) == NULL)
+	    pp->failed = 1;
+	else
+	    *p = (char)i;
+	while (i - __atomic_load_n(&pp->tail, __ATOMIC_ACQUIRE) >= RING_SIZE)
+	    sched_yield();
+	pp->ring[i % RING_SIZE] = p;
+	__atomic_store_n(&pp->head, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* consumer_thread - frees the THREAD_OPS blocks its producer sends */
+static void *consumer_thread(void *ptr)
+{
+    pipe_t *pp = ptr;
+    unsigned i;
+
+    pthread_barrier_wait(pp->start);
+    for (i = 0; i < THREAD_OPS; i++) {
+	while (__atomic_load_n(&pp->head, __ATOMIC_ACQUIRE) == i)
+	    sched_yield();
+	mm_free(pp->ring[i % RING_SIZE]);
+	__atomic_store_n(&pp->tail, i + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/*
+ * eval_mm_pipes - Runs npairs producer/consumer pairs at once, every block
+ *    is malloced by one thread and freed by another. The block sizes are
+ *    the malloc sizes of the trace. Runs once with one arena and once with
+ *    an arena per thread, where every free is a remote free.
+ */
+static void eval_mm_pipes(trace_t *trace, char *name, int npairs)
+{
+    int i, k, n, narenas, failed;
+    int *sizes;
+    double secs;
+    struct timespec t0, t1;
+    pthread_t *tids;
+    pipe_t *pipes;
+    pthread_barrier_t start;
+
+    if ((sizes = malloc(trace->num_ops * sizeof(int))) == NULL)
+	unix_error("malloc in eval_mm_pipes failed");
+    for (i = n = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].type == ALLOC)
+	    sizes[n++] = trace->ops[i].size;
+    tids = malloc(2 * npairs * sizeof(pthread_t));
+    pipes = malloc(npairs * sizeof(pipe_t));
+    if (tids == NULL || pipes == NULL)
+	unix_error("malloc in eval_mm_pipes failed");
+
+    for (k = 0; k < 2 && n > 0; k++) {
+	narenas = k ? 2 * npairs : 1;
+	if (mm_set_arenas(narenas) < 0) {
+	    printf("%-20s%8d%8d%10s%10s\n", name, npairs, narenas, "-", "n/a");
+	    continue;
+	}
+	mem_reset_brk();
+	if (mm_init() < 0)
+	    app_error("mm_init failed in eval_mm_pipes");
+	pthread_barrier_init(&start, NULL, 2 * npairs + 1);
+	for (i = 0; i < npairs; i++) {
+	    pipes[i].sizes = sizes;
+	    pipes[i].nsizes = n;
+	    pipes[i].head = pipes[i].tail = 0;
+	    pipes[i].start = &start;
+	    pipes[i].failed = 0;
+	    if (pthread_create(&tids[2*i], NULL, producer_thread, &pipes[i]) != 0 ||
+		pthread_create(&tids[2*i+1], NULL, consumer_thread, &pipes[i]) != 0)
+		unix_error("pthread_create in eval_mm_pipes failed");
+	}
+	pthread_barrier_wait(&start);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	failed = 0;
+	for (i = 0; i < 2 * npairs; i++)
+	    pthread_join(tids[i], NULL);
+	for (i = 0; i < npairs; i++)
+	    failed |= pipes[i].failed;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	pthread_barrier_destroy(&start);
+
+	if (failed) {
+	    printf("%-20s%8d%8d%10s%10s\n", name, npairs, narenas, "-", "no mem");
+	    continue;
+	}
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%-20s%8d%8d%10.6f%10.0f\n", name, npairs, narenas, secs,
+	       2.0 * THREAD_OPS * npairs / secs / 1e3);
+    }
+    mm_set_arenas(1);
+    free(sizes);
+    free(tids);
+    free(pipes);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -841,7 +2023,7 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i, j, newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -866,9 +2048,56 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    break;
 	    
         case FREE: /* free */
+        case SFREE:
+        case PPUT:
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
+        case MEMALIGN: /* posix_memalign */
+        case PGET:     /* libc has no pools either */
+	    if (posix_memalign((void **)&p, trace->ops[i].align, trace->ops[i].size) != 0) {
+		malloc_error(tracenum, i, "libc posix_memalign failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc calloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case BALLOC: /* libc has no batches, one malloc per block */
+	    for (j = 0; j < trace->ops[i].count; j++) {
+		if ((p = malloc(trace->ops[i].size)) == NULL) {
+		    malloc_error(tracenum, i, "libc malloc failed");
+		    unix_error("System message");
+		}
+		trace->blocks[trace->ops[i].index + j] = p;
+	    }
+	    break;
+
+        case BFREE:
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
+        case RALLOC: /* libc has no regions, a malloc per object */
+	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+		malloc_error(tracenum, i, "libc malloc failed");
+		unix_error("System message");
+	    }
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
+
+        case RRESET: /* and a free per object */
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[trace->ops[i].index + j]);
+	    break;
+
 	default:
 	    app_error("invalid operation type  in eval_libc_valid");
 	}
@@ -884,7 +2113,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
+    int i, j;
     int index, size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
@@ -910,10 +2139,48 @@ static void eval_libc_speed(void *ptr)
 	    break;
 	    
         case FREE: /* free */
+        case SFREE:
+        case PPUT:
 	    index = trace->ops[i].index;
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+        case MEMALIGN: /* posix_memalign */
+        case PGET:     /* libc has no pools either */
+	    index = trace->ops[i].index;
+	    if (posix_memalign((void **)&p, trace->ops[i].align, trace->ops[i].size) != 0)
+		unix_error("posix_memalign failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case CALLOC: /* calloc */
+	    index = trace->ops[i].index;
+	    if ((p = calloc(1, trace->ops[i].size)) == NULL)
+		unix_error("calloc failed in eval_libc_speed");
+	    trace->blocks[index] = p;
+	    break;
+
+        case BALLOC: /* one malloc per block */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		if ((trace->blocks[index + j] = malloc(size)) == NULL)
+		    unix_error("malloc failed in eval_libc_speed");
+	    break;
+
+        case BFREE: /* one free per block */
+        case RRESET:
+	    index = trace->ops[i].index;
+	    for (j = 0; j < trace->ops[i].count; j++)
+		free(trace->blocks[index + j]);
+	    break;
+
+        case RALLOC: /* one malloc per object */
+	    if ((p = malloc(trace->ops[i].size)) == NULL)
+		unix_error("malloc failed in eval_libc_speed");
+	    trace->blocks[trace->ops[i].index] = p;
+	    break;
 	}
     }
 }
@@ -980,6 +2247,46 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printcounts - Print how often mm.c split and merged blocks in the
+ *     util run of every trace, how many mallocs came off its quick lists,
+ *     how many reallocs had to copy, how many -u could skip and how
+ *     often the heap was extended
+ */
+static void printcounts(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%12s%10s%10s%10s%10s\n", "trace", "splits", "merges", "quick hits", "flushes", "moves", "skipped", "extends");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid)
+	    printf("%2d%13zu%10zu%12zu%10zu%10zu%10d%10zu\n", i,
+		   stats[i].counts.splits, stats[i].counts.merges,
+		   stats[i].counts.quick_hits, stats[i].counts.quick_flushes,
+		   stats[i].counts.moves, stats[i].skipped, stats[i].counts.extends);
+    }
+}
+
+/*
+ * printheap - Print how big the heap (with mapped regions) got in the
+ *     util run of every trace and how much of it was left at the end,
+ *     how much mm.c trimmed off its end and gave back with madvise,
+ *     and how many bytes mm_calloc had to clear
+ */
+static void printheap(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%10s%10s%10s\n", "trace", "peak KB", "final KB", "trim KB", "madv KB", "zero KB");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid)
+	    printf("%2d%13zu%10zu%10zu%10zu%10zu\n", i,
+		   stats[i].peak_heap >> 10, stats[i].final_heap >> 10,
+		   stats[i].counts.trimmed >> 10, stats[i].counts.released >> 10,
+		   stats[i].counts.zeroed >> 10);
+    }
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -998,6 +2305,52 @@ void unix_error(char *msg)
     exit(1);
 }
 
+/*
+ * parse_policy - Set the mm placement policy from a -p argument of the form
+ *     first | next | best | good[:probes[:slack]]
+ *     Returns what mm_set_policy returns, or -1 for an unknown name.
+ */
+static int parse_policy(char *arg)
+{
+    int probes;
+    unsigned slack;
+
+    if (!strcmp(arg, "first"))
+	return mm_set_policy(MM_FIRST_FIT);
+    if (!strcmp(arg, "next"))
+	return mm_set_policy(MM_NEXT_FIT);
+    if (!strcmp(arg, "best"))
+	return mm_set_policy(MM_BEST_FIT);
+    if (!strncmp(arg, "good", 4)) {
+	if (sscanf(arg, "good:%d:%u", &probes, &slack) == 2)
+	    mm_set_good_fit(probes, slack);
+	else if (sscanf(arg, "good:%d", &probes) == 1)
+	    mm_set_good_fit(probes, 4*ALIGNMENT);
+	return mm_set_policy(MM_GOOD_FIT);
+    }
+    return -1;
+}
+
+/*
+ * parse_growth - Set the heap growth of mm.c from a -G argument of the
+ *     form min[:max[:ramp]], a missing max is min (a fixed step) and a
+ *     missing ramp 4. Returns -1 if it can't be read.
+ */
+static int parse_growth(char *arg)
+{
+    unsigned long min, max;
+    unsigned ramp = 4;
+    int n;
+
+    n = sscanf(arg, "%lu:%lu:%u", &min, &max, &ramp);
+    if (n < 1)
+	return -1;
+    if (n == 1)
+	max = min;
+    mm_set_growth(min, max, ramp);
+    return 0;
+}
+
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
@@ -1012,14 +2365,29 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValbcdorsuzCH] [-f <file>] [-t <dir>] [-p <policy>] [-m <bytes>] [-G <growth>] [-T <n>] [-P <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-b         Replay batch requests as single mallocs and frees.\n");
+    fprintf(stderr, "\t-c         Replay callocs as mm_malloc and memset.\n");
+    fprintf(stderr, "\t-C         Check the heap (mm_check_touched) after every request.\n");
+    fprintf(stderr, "\t-d         Defer coalescing of small blocks (quick lists).\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
+    fprintf(stderr, "\t-G <grow>  Heap growth steps of mm.c: min[:max[:ramp]] bytes.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Replay mallocs, reallocs and frees as movable blocks.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m <bytes> Map requests of at least <bytes> outside the heap, 0 never.\n");
+    fprintf(stderr, "\t-o         Replay pool requests as mm_malloc and mm_free.\n");
+    fprintf(stderr, "\t-p <pol>   Placement policy: first, next, best or good[:probes[:slack]].\n");
+    fprintf(stderr, "\t-r         Replay region requests as mm_malloc and mm_free.\n");
+    fprintf(stderr, "\t-s         Replay every free as mm_free_sized.\n");
+    fprintf(stderr, "\t-P <n>     Also time <n> producer/consumer pairs (cross-thread free).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also time the traces on 1 up to <n> threads.\n");
+    fprintf(stderr, "\t-u         Skip reallocs that fit in what mm_usable_size says.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
+    fprintf(stderr, "\t-z         Start every run on a zero heap, like a new process.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -2,7 +2,17 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *            Besides the heap it hands out real anonymous mappings
+ *            (mem_map) and keeps a list of them, so the driver can check
+ *            payloads in them and count them in the footprint.
+ *            The heap itself is an anonymous mapping too, so it is zero
+ *            until it is written. mem_heap_clean tells how much of it
+ *            still is.
+ *            A second heap with a brk of its own (mem_hsbrk) holds the
+ *            blocks mm.c may move, it counts in the footprint like the
+ *            others.
  */
+#define _GNU_SOURCE             /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -10,6 +20,7 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -18,20 +29,52 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static char *mem_clean;      /* the heap is all zero from here up */
+static int fresh_heaps = 0;  /* mem_reset_brk zeroes the old heap (mem_fresh_heaps) */
+static char *mem_hstart;     /* first byte of the movable heap */
+static char *mem_hbrk;       /* end of the movable heap */
+
+/* a region handed out by mem_map */
+typedef struct map {
+    char *lo;                /* first byte of the mapping */
+    size_t size;             /* its length in bytes */
+    struct map *next;
+} map_t;
+
+static map_t *maps = NULL;   /* all regions that are mapped right now */
+static size_t map_bytes = 0; /* bytes in those regions */
+static size_t peak_bytes = 0; /* most heap + mapped bytes since mem_reset_brk */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER; /* guards the above and mem_brk */
+
+static void update_peak(void);
+static char *page_up(char *p);
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-        fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* allocate the storage we will use to model the available VM, pages
+     * only get memory (zeroed) once they are touched */
+    mem_start_brk = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+        fprintf(stderr, "mem_init_vm: mmap error\n");
         exit(1);
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_clean = mem_start_brk;
+
+    /* the movable heap gets as much room */
+    mem_hstart = mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_hstart == MAP_FAILED) {
+        fprintf(stderr, "mem_init_vm: mmap error\n");
+        exit(1);
+    }
+    mem_hbrk = mem_hstart;
 }
 
 /* 
@@ -39,35 +82,271 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, MAX_HEAP);
+    munmap(mem_hstart, MAX_HEAP);
 }
 
 /*
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ *    The old heap keeps its pages (and whatever is in them) unless
+ *    mem_fresh_heaps is on.
  */
 void mem_reset_brk()
 {
+    map_t *m;
+
+    pthread_mutex_lock(&mem_lock);
     mem_brk = mem_start_brk;
+    if (fresh_heaps && mem_clean > mem_start_brk) {
+        madvise(mem_start_brk, page_up(mem_clean) - mem_start_brk, MADV_DONTNEED);
+        mem_clean = mem_start_brk;
+    }
+
+    if (mem_hbrk > mem_hstart)
+        madvise(mem_hstart, page_up(mem_hbrk) - mem_hstart, MADV_DONTNEED);
+    mem_hbrk = mem_hstart;
+
+    /* whatever the last run left mapped goes away with its heap */
+    while ((m = maps) != NULL) {
+        maps = m->next;
+        munmap(m->lo, m->size);
+        free(m);
+    }
+    map_bytes = 0;
+    peak_bytes = 0;
+    pthread_mutex_unlock(&mem_lock);
+}
+
+/*
+ * mem_fresh_heaps - with on, mem_reset_brk gives the pages of the old
+ *    heap back, so every heap starts out zero like in a new process
+ */
+void mem_fresh_heaps(int on)
+{
+    fresh_heaps = on;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.
+ *    A negative incr shrinks the heap, the pages in the part that goes
+ *    away are given back to the system like a real sbrk would.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk;
+    char *lo, *hi;
 
-    if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    pthread_mutex_lock(&mem_lock);
+    old_brk = mem_brk;
+    if (incr < 0 && old_brk + incr < mem_start_brk) {
+        pthread_mutex_unlock(&mem_lock);
+        errno = EINVAL;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Heap can't shrink below its start...\n");
+        return (void *)-1;
+    }
+    if ((incr > 0) && ((old_brk + incr) > mem_max_addr)) {
+        pthread_mutex_unlock(&mem_lock);
         errno = ENOMEM;
         fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
         return (void *)-1;
     }
     mem_brk += incr;
+    update_peak();
+    if (mem_brk > mem_clean)
+        mem_clean = mem_brk;
+    if (incr < 0) {
+        /* the partial page at the old end goes too, nothing is behind it.
+         * Unless an old heap is still left up there it is all zero now */
+        lo = page_up(mem_brk);
+        hi = page_up(old_brk);
+        if (lo < hi && madvise(lo, hi - lo, MADV_DONTNEED) == 0 && mem_clean <= hi)
+            mem_clean = lo;
+    }
+    pthread_mutex_unlock(&mem_lock);
     return (void *)old_brk;
 }
 
+/*
+ * mem_hsbrk - mem_sbrk for the movable heap, returns the old end of it
+ *    or (void *)-1. Shrinking gives the pages that go away back too.
+ */
+void *mem_hsbrk(intptr_t incr)
+{
+    char *old_brk;
+    char *lo, *hi;
+
+    pthread_mutex_lock(&mem_lock);
+    old_brk = mem_hbrk;
+    if ((incr < 0 && old_brk + incr < mem_hstart) ||
+        (incr > 0 && old_brk + incr > mem_hstart + MAX_HEAP)) {
+        pthread_mutex_unlock(&mem_lock);
+        errno = incr < 0 ? EINVAL : ENOMEM;
+        fprintf(stderr, "ERROR: mem_hsbrk failed. Movable heap out of range...\n");
+        return (void *)-1;
+    }
+    mem_hbrk += incr;
+    update_peak();
+    if (incr < 0) {
+        lo = page_up(mem_hbrk);
+        hi = page_up(old_brk);
+        if (lo < hi)
+            madvise(lo, hi - lo, MADV_DONTNEED);
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return (void *)old_brk;
+}
+
+/*
+ * mem_hheap_lo - first byte of the movable heap
+ */
+void *mem_hheap_lo()
+{
+    return (void *)mem_hstart;
+}
+
+/*
+ * mem_hheapsize - bytes in the movable heap
+ */
+size_t mem_hheapsize()
+{
+    return (size_t)(mem_hbrk - mem_hstart);
+}
+
+/*
+ * mem_map - get a fresh anonymous mapping of size bytes (a multiple of
+ *    the page size) outside the heap, or NULL if there is none
+ */
+void *mem_map(size_t size)
+{
+    map_t *m;
+    char *lo;
+
+    lo = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (lo == MAP_FAILED)
+        return NULL;
+    if ((m = malloc(sizeof(map_t))) == NULL) {
+        munmap(lo, size);
+        return NULL;
+    }
+    m->lo = lo;
+    m->size = size;
+    pthread_mutex_lock(&mem_lock);
+    m->next = maps;
+    maps = m;
+    map_bytes += size;
+    update_peak();
+    pthread_mutex_unlock(&mem_lock);
+    return lo;
+}
+
+/* find_map - the link that points at the region starting at lo, mem_lock is held */
+static map_t **find_map(char *lo)
+{
+    map_t **mp;
+
+    for (mp = &maps; *mp != NULL; mp = &(*mp)->next)
+        if ((*mp)->lo == lo)
+            return mp;
+    fprintf(stderr, "ERROR: %p was never mapped by mem_map\n", lo);
+    exit(1);
+}
+
+/*
+ * mem_unmap - give back the region at lo that mem_map handed out
+ */
+void mem_unmap(void *lo)
+{
+    map_t **mp, *m;
+
+    pthread_mutex_lock(&mem_lock);
+    mp = find_map(lo);
+    m = *mp;
+    *mp = m->next;
+    map_bytes -= m->size;
+    pthread_mutex_unlock(&mem_lock);
+    munmap(m->lo, m->size);
+    free(m);
+}
+
+/*
+ * mem_remap - resize the region at lo to size bytes, moving it if it
+ *    can't grow where it is. Returns its (new) start or NULL, then the
+ *    old region is still there.
+ */
+void *mem_remap(void *lo, size_t size)
+{
+    map_t *m;
+    char *newlo;
+
+    pthread_mutex_lock(&mem_lock);
+    m = *find_map(lo);
+    newlo = mremap(m->lo, m->size, size, MREMAP_MAYMOVE);
+    if (newlo == MAP_FAILED) {
+        pthread_mutex_unlock(&mem_lock);
+        return NULL;
+    }
+    map_bytes += size - m->size;
+    m->lo = newlo;
+    m->size = size;
+    update_peak();
+    pthread_mutex_unlock(&mem_lock);
+    return newlo;
+}
+
+/*
+ * mem_is_mapped - is all of lo..hi inside one region from mem_map
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    map_t *m;
+    int found = 0;
+
+    pthread_mutex_lock(&mem_lock);
+    for (m = maps; m != NULL; m = m->next) {
+        if ((char *)lo >= m->lo && (char *)hi < m->lo + m->size) {
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mem_lock);
+    return found;
+}
+
+/*
+ * mem_mapsize - bytes in all regions that are mapped right now
+ */
+size_t mem_mapsize()
+{
+    return map_bytes;
+}
+
+/*
+ * mem_peaksize - the most bytes the heaps and mapped regions took together
+ *    since mem_reset_brk
+ */
+size_t mem_peaksize()
+{
+    return peak_bytes;
+}
+
+/* page_up - p rounded up to a page boundary */
+static char *page_up(char *p)
+{
+    size_t page = mem_pagesize();
+
+    return (char *)(((size_t)p + page - 1) & ~(page - 1));
+}
+
+/* update_peak - remember the footprint if it is a new high */
+static void update_peak(void)
+{
+    size_t now = (size_t)(mem_brk - mem_start_brk) + (size_t)(mem_hbrk - mem_hstart) + map_bytes;
+
+    if (now > peak_bytes)
+        peak_bytes = now;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -84,6 +363,15 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
+/*
+ * mem_heap_clean - every heap byte from here up is zero, none of it was
+ *    handed out by mem_sbrk since it was last given back to the system
+ */
+void *mem_heap_clean()
+{
+    return (void *)mem_clean;
+}
+
 /*
  * mem_heapsize() - returns the heap size in bytes
  */
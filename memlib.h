@@ -1,11 +1,27 @@
 #include <unistd.h>
+#include <stdint.h>
 
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
+void *mem_heap_clean(void);
+void mem_fresh_heaps(int on);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
+/* the heap for blocks that can move, with a brk of its own */
+void *mem_hsbrk(intptr_t incr);
+void *mem_hheap_lo(void);
+size_t mem_hheapsize(void);
+
+/* regions outside the heap, for blocks too big for it */
+void *mem_map(size_t size);
+void mem_unmap(void *lo);
+void *mem_remap(void *lo, size_t size);
+int mem_is_mapped(void *lo, void *hi);
+size_t mem_mapsize(void);
+size_t mem_peaksize(void);
+
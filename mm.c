@@ -1,19 +1,226 @@
 /* 
  * mm.c 
  *
- * Each block has header and footer of the form:
+ * Each block has a header of the form:
  * 
  *      31                     3  2  1  0 
  *      -----------------------------------
- *     | s  s  s  s  ... s  s  s  0  0  a/f
+ *     | s  s  s  s  ... s  s  s  g pa a/f
  *      ----------------------------------- 
  * 
- * We will be using explicit free list with first fit implementation.
+ * where pa is set iff the block right before it in the heap is allocated
+ * and g is set iff the block is allocated and realloc is keeping track of
+ * how it grows (see below).
+ * In a 64-bit build (make mdriver64) headers, footers and free list links
+ * are 8 bytes and every payload is 16 byte aligned, so the header goes up
+ * to bit 63 and the low 4 bits of the size are always 0.
+ * Only free blocks have a footer (a copy of the header). coalesce is the only
+ * one who reads footers and it only needs the footer of a free neighbour,
+ * the pa bit tells it if there is one, so allocated blocks don't need one.
+ * 
+ * We will be using segregated explicit free lists with first fit implementation.
  * We started out with mm-firstfit.c which is an implicit list implementation
  * and worked from there.
  * Each free block has a header and a footer which contain size/allocation
- * information about the block(see above). The block also has a next and prev
- * pointer that points to the next and previous free blocks in the list.
+ * information about the block(see above), an allocated block only has the header. The block also has a next and prev
+ * pointer that points to the next and previous free blocks in its list.
+ *
+ * Free blocks are kept in NUM_CLASSES lists, one per size class. Class 0
+ * holds blocks of at most MIN_BLOCK bytes and every class after that holds
+ * blocks up to twice the limit of the class before it, the last class goes
+ * up to TREE_MIN. find_fit starts at the class of the request so
+ * the cost of a malloc depends on its size class and not on how many
+ * small fragments are lying around in the heap.
+ *
+ * Free blocks bigger than TREE_MIN are not in a list but in a splay tree
+ * keyed by size that lives in the payloads of the free blocks. Every size
+ * is in the tree once, the other free blocks of that size hang off the
+ * tree node in a chain. Large requests get the best fit out of the tree in
+ * O(log n) (amortized) instead of the first fit of a list walk, which is
+ * what keeps big buffers from chopping up the heap.
+ *
+ * A free block in the tree looks like this:
+ *  -------------------------------------------------------------------------
+ * | header | left | right | chain next | chain prev | free space ... | footer |
+ *  -------------------------------------------------------------------------
+ * chain prev is NULL for the tree node itself and points back along the
+ * chain (to the node for the first one) for the other blocks of that size.
+ *
+ * How we pick a block in the lists is up to the placement policy, which can
+ * be changed at run time with mm_set_policy (mdriver -p):
+ *     first fit - the first block that fits in the class of the request
+ *     next fit  - like first fit, but every class remembers where the last
+ *                 search ended (its rover) and the next one starts there
+ *     best fit  - the smallest block that fits
+ *     good fit  - best fit, but give up after a few probes or as soon as
+ *                 a block wastes little enough space
+ * Above the lists the tree always gives the best fit. The TLSF engine has
+ * its own good fit built in and only takes the default policy.
+ *
+ * The allocator can be used from many threads. The heap is split in up to
+ * MAX_ARENAS arenas (mm_set_arenas, one by default), every arena has its
+ * own free lists, tree, slabs and lock. Threads are handed an arena round
+ * robin the first time they call us and malloc from that one, free always
+ * gives a block back to the arena that owns it. The public mm_ functions
+ * lock the arena, point the thread's arena variable at it and call the do_
+ * versions that do the real work on whatever arena points at.
+ *
+ * An arena gets its memory from memlib in segments. When an arena grows
+ * and nobody else has grown the heap since it last did, the new memory
+ * just extends its last segment like it always did. Otherwise it starts
+ * a new segment with a prologue and epilogue of its own, so blocks never
+ * coalesce into someone else's memory. With more than one arena segments
+ * start on a page boundary and the arena map says which arena owns every
+ * page, that is how free finds the owner of a block.
+ *
+ * A thread that frees a block of some other arena doesn't take that
+ * arena's lock. It pushes the block on the arena's remote free queue with
+ * a single compare and swap (the queue is linked through the first word of
+ * the blocks). Whoever mallocs from the arena next takes the whole queue
+ * with one exchange, while it holds the lock anyway, and frees the blocks
+ * for real so they coalesce like any other free. Many threads push, only
+ * the lock holder pops, and it always pops everything, so there is no ABA.
+ *
+ * To keep the common malloc/free pair off the lock
+ * every thread has a small cache of blocks it freed, one bin per size class
+ * (slab class for tiny objects, block size up to TCACHE_MAX otherwise).
+ * Cached blocks stay allocated as far as the heap knows, so nothing but
+ * their own thread ever touches them. The caches only switch on once a
+ * second thread has called us, a single threaded program gets exactly the
+ * heap it got before. mm_init starts a new heap epoch, caches from an older
+ * epoch are dropped, and a thread that exits gives its cache back.
+ *
+ * Coalescing can be deferred (mm_set_deferred, mdriver -d). Then a freed
+ * block of at most QUICK_MAX bytes is not merged with its neighbours but
+ * pushed on the quick list of its exact size, still marked allocated, and
+ * a malloc of that size pops it again without a split. When a quick list
+ * gets longer than QUICK_COUNT, or nothing in the free lists fits and we
+ * would have to grow the heap, all quick lists are freed for real in one
+ * go. Every arena counts its splits and merges (mm_get_counts) so we can
+ * see how many of them the quick lists save.
+ *
+ * Buffers that are grown a few bytes at a time by realloc would be copied
+ * over and over. realloc remembers the blocks it grows in a small table
+ * per arena (GROW_SLOTS entries, the g bit says a block is in it), with
+ * how often it grew and the size that was asked for last. From the
+ * GROW_DETECT'th grow on the block gets a sixteenth of its size extra, up
+ * to GROW_SLACK_MAX, so the copies and heap extensions get rarer the bigger
+ * it gets. More slack saves a few more copies but the holes a moving block
+ * leaves behind get too big to fill, half its size halved the util of
+ * realloc-bal. A realloc below the size asked for last is a real shrink and
+ * gives the slack back, free gives it back with the block.
+ *
+ * Huge requests, at least mmap_threshold bytes (mm_set_mmap_threshold,
+ * mdriver -m), stay out of the heap. Each one gets an anonymous mapping of
+ * its own from memlib with the payload DSIZE bytes in (or the alignment
+ * of mm_memalign, up to a page), right after a header that holds the
+ * length of the mapping. free unmaps it and realloc
+ * resizes it with mremap, which moves pages instead of copying bytes. The
+ * heap is one MAX_HEAP range from memlib, so a pointer outside of it is a
+ * huge block, that is how free tells them apart without a lock.
+ *
+ * Memory goes back after a spike. When a free leaves a free block of at
+ * least TRIM_MIN bytes at the very end of the heap, the heap is shrunk
+ * (memlib takes a negative sbrk) until TRIM_KEEP bytes of it are left.
+ * A free block of at least RELEASE_MIN bytes anywhere else keeps its
+ * address space, but the whole pages inside it are handed back with
+ * madvise(MADV_DONTNEED), all but its first RELEASE_KEEP bytes and the
+ * page with the footer. Such a block gets RELEASED in its footer, a free
+ * next to it only releases the part that was just freed (and neighbours
+ * without the bit), so a row of frees next to a big block doesn't madvise
+ * it over and over. The bit goes along when place and carve split the
+ * block and when it coalesces. The bytes we keep are where place takes
+ * from, so a released block that is split and freed again and again (a
+ * hole between live blocks, the segment of an arena) doesn't fault the
+ * same pages in and out. Nothing goes back while the heap still grows
+ * every now and then, we would get the same pages again a moment later:
+ * it takes QUIET_FREES frees without an extension, or a SPIKE_SHARE'th of
+ * the heap freed since the last one (the spike is over). Then every free
+ * also looks at the end of the heap, the frees before may have left it
+ * there.
+ *
+ * calloc doesn't have to clear memory nobody wrote yet. memlib's heap is
+ * zero until it is handed out (mem_heap_clean says where that starts) and
+ * every arena keeps a fresh mark in its newest segment: from there to
+ * its end nothing was ever given to a user, the only words we wrote in
+ * there are the footer at the very end (and the epilogue behind it). Every
+ * place that hands out a block moves the mark behind it and behind the
+ * links of the free block that follows (used), a heap extension moves it
+ * up to where memlib's clean memory started (fresh_grow). do_calloc then
+ * only clears the part of a block below the old mark, plus the footer if
+ * it took the free block up to the end.
+ *
+ * Regions (mm_region_create) are for objects that all die together. A
+ * region gets chunks with mm_malloc and hands out their payload by bumping
+ * a pointer, nothing is freed one by one. The chunks are linked through
+ * their first DSIZE bytes, newest first. A request bigger than a
+ * REGION_BIG'th of a chunk gets a chunk of its own, linked in behind the
+ * newest one so the space left there isn't lost. mm_region_reset frees
+ * every chunk but the newest and starts over in that, mm_region_destroy
+ * frees them all, both with one mm_free per chunk.
+ *
+ * Pools (mm_pool_create) are for objects of one size that come and go all
+ * the time. A pool takes chunks of at least POOL_CHUNK bytes from
+ * mm_malloc (mm_memalign for alignments above DSIZE) and cuts them into
+ * objects. Free objects are on a stack linked through their first word,
+ * so mm_pool_get and mm_pool_put are a pop and a push. The first
+ * alignment's worth of a chunk links it to the pool's other chunks, the
+ * chunks go back to the heap only when the pool is destroyed.
+ *
+ * Blocks behind a handle (mm_halloc) can move, they live in memlib's
+ * second, movable heap (mem_hsbrk) and the caller only gets a pointer to
+ * one while it has it locked (mm_hlock). The handle is an index in a table
+ * that holds where the block is and how often it is locked. The table is a
+ * mapping of its own from memlib (mem_map, grown with mem_remap), so it
+ * takes nothing from either heap. A movable block has a DSIZE header with
+ * its size and its handle:
+ *  ------------------------------------------
+ * | size/used | handle | payload ...         |
+ *  ------------------------------------------
+ * New blocks go at the top of the movable heap. The compactor sweeps it
+ * from the bottom up: below hdense there are no gaps, from there to hscan
+ * is one free gap, and every unlocked block it finds at hscan slides down
+ * to hdense. A locked block stays where it is and the gap in front of it
+ * is left as a free block until that block is unlocked. When the sweep
+ * reaches the top the gap is cut off and the movable heap shrinks, the next
+ * sweep starts at the lowest block freed since. Every mm_halloc and mm_hfree
+ * moves at most HSTEP bytes, an mm_halloc that would have to grow the heap
+ * HGROW times what it would grow by first, mm_hcompact does more when the
+ * caller has time. A new block takes the front of the gap when it fits
+ * there.
+ *
+ * The heap doesn't always grow by the same CHUNKSIZE. Every arena has a
+ * growth step that starts at grow_min and learns from what happened since
+ * its last extension (grow_size): when it handed out half a step or more
+ * and at least grow_ramp bytes per byte freed, mallocs keep missing the
+ * free lists and it is ramping up, so the step doubles up to grow_max and
+ * holds at least GROW_REQS of the requests it saw lately; when the frees
+ * kept up with the mallocs it halves again. What the last step leaves unused at the peak
+ * counts against util, so a step is never more than a GROW_SHARE'th of
+ * the arena's heap. mm_set_growth (mdriver -G) sets the three, min = max
+ * is the old fixed step.
+ *
+ * When built with USE_TLSF set (make mdriver-tlsf) the lists are instead
+ * indexed two-level segregated fit style. The first level splits sizes
+ * into powers of two and the second level splits every power of two into
+ * SL_COUNT equal ranges. A bitmap for each level tells which lists are non
+ * empty so find_fit is a couple of find-first-set instructions and never
+ * has to look at a block that is too small. malloc, free and coalesce then
+ * do a bounded amount of work no matter how many blocks are free.
+ *
+ * Requests below SLAB_MAX bytes don't get a block of their own. They are
+ * handed out from slabs, one SLAB_SIZE page per slab, where every slab only
+ * holds objects of one size class. The objects have no header or footer,
+ * a bitmap in the slab header says which ones are in use. A slab is itself
+ * an allocated block in the heap whose payload is page aligned, so mm_free
+ * finds the slab header of a tiny object by masking off the low bits of its
+ * address. The page map tells mm_free which pages are slabs.
+ *
+ * A slab looks like this:
+ *  ----------------------------------------------------------------
+ * | hdr | slab header - lists/class/bitmap | obj | obj | ... | obj |
+ *  ----------------------------------------------------------------
+ *       ^ page boundary
  * 
  * A free block looks like this:
  *  ------------------------------------------------------------------------------------
@@ -21,22 +228,24 @@
  *  ------------------------------------------------------------------------------------
  *
  * An allocated block looks like this:
- *  ----------------------------------------------------------------------
- * | header -size/allocated | payload + padding | footer - size/allocated |
- *  ----------------------------------------------------------------------
+ *  ---------------------------------------------------------
+ * | header - size/prev allocated/allocated | payload + padding |
+ *  ---------------------------------------------------------
  *
  *
  *
- * The heap looks like this:
+ * A heap segment looks like this:
  *
  * begin                                                          end
- * heap                                                           heap  
+ * segment                                                        segment
  *  -----------------------------------------------------------------   
- * |  pad   | hdr(8:a) | ftr(8:a) | zero or more usr blks | hdr(0:a) |
+ * |  link  | hdr(8:a) | ftr(8:a) | zero or more usr blks | hdr(0:a) |
  *  -----------------------------------------------------------------
  *          |       prologue      |                       | epilogue |
  *          |         block       |                       | block    |
  *
+ * link points at the segment of the same arena that came before it.
+ *
  * The allocated prologue and epilogue blocks are overhead that
  * eliminate edge conditions during coalescing.
  * 
@@ -45,8 +254,11 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
@@ -85,55 +297,148 @@ team_t team = {
 /* $begin mallocmacros */
 /* Basic constants and macros */
 
+#ifdef __LP64__
+#define WSIZE       8        /* word size (bytes), big enough for a pointer */
+#define DSIZE       16       /* doubleword size (bytes), also the alignment */
+#else
 #define WSIZE       4        /* word size (bytes) */
 #define DSIZE       8        /* doubleword size (bytes) */
-#define CHUNKSIZE  (1 << 12) /* initial heap size (bytes) */
-#define OVERHEAD    8        /* overhead of header and footer (bytes) */
+#endif
+#define CHUNKSIZE  (1 << 12) /* smallest step the heap grows by (bytes) */
+#define OVERHEAD    WSIZE    /* overhead of an allocated block, just the header (bytes) */
+#define MIN_BLOCK  (2*DSIZE) /* smallest block we ever make, a free block needs header/prev/next/footer (bytes) */
+#define ALLOC       0x1      /* allocated bit in the header */
+#define PREV_ALLOC  0x2      /* previous block allocated bit in the header */
+#define GROWN       0x4      /* block is in the arena's grow table bit in the header */
+#define RELEASED    0x2      /* pages of the free block were given back bit in the footer */
+
+/* Set CHECK_SIZED to 1 to have mm_free_sized check the size it is given */
+#ifndef CHECK_SIZED
+#define CHECK_SIZED 0
+#endif
+
+/* Set USE_TLSF to 1 to use the two-level segregated fit engine */
+#ifndef USE_TLSF
+#define USE_TLSF 0
+#endif
+
+#if USE_TLSF
+#define SL_LOG2     4                     /* log2 of the second level lists per first level */
+#define SL_COUNT   (1 << SL_LOG2)
+#define FL_SHIFT   (SL_LOG2 + 3)          /* sizes below 1 << FL_SHIFT are all in first level 0 */
+#define FL_COUNT   ((int)sizeof(size_t)*8 - FL_SHIFT + 1)
+#define NUM_CLASSES (FL_COUNT * SL_COUNT) /* number of segregated free lists */
+#else
+#define TREE_MIN    (1 << 10) /* free blocks bigger than this go in the tree (bytes) */
+#define NUM_CLASSES 7        /* number of segregated free lists, 16 .. TREE_MIN */
+#endif
+
+#define SLAB_SHIFT   12                  /* log2 of the slab size */
+#define SLAB_SIZE    (1 << SLAB_SHIFT)   /* a slab is one page (bytes) */
+#define SLAB_MAX     64                  /* requests below this come from slabs (bytes) */
+#define SLAB_CLASSES (SLAB_MAX/DSIZE) /* one slab class per DSIZE step */
+#define SLAB_WORDS   (SLAB_SIZE/DSIZE/32) /* bitmap words needed for the most objects a slab can hold */
+#define PAGE_SLAB    1                   /* page map entry of a page that is a slab */
+
+#define QUICK_MAX    256                 /* deferred frees keep blocks up to this size (bytes) */
+#define QUICK_BINS   (QUICK_MAX/DSIZE + 1) /* one quick list per block size */
+#define QUICK_COUNT  32                  /* a quick list longer than this is flushed */
+
+#define GROW_SLOTS   16                  /* blocks realloc keeps track of per arena */
+#define TOUCH_LOG    64                  /* blocks an arena remembers for mm_check_touched */
+#define GROW_DETECT  2                   /* grows before a block gets slack */
+#define GROW_SLACK_SHIFT 4               /* a growing block gets size >> this as slack */
+#define GROW_SLACK_MAX (1 << 20)         /* most slack a growing block gets (bytes) */
+
+#define HUGE_MIN     (1 << 17)           /* default mmap_threshold (bytes) */
+#define TRIM_MIN     (1 << 17)           /* a free block this big at the heap end is trimmed (bytes) */
+#define TRIM_KEEP    CHUNKSIZE           /* what is left of it (bytes) */
+#define RELEASE_MIN  (1 << 16)           /* free blocks this big give their pages back (bytes) */
+#define RELEASE_KEEP (1 << 15)           /* but not the ones this close to their start (bytes) */
+#define QUIET_FREES  1024                /* frees without a heap extension before we give anything back ... */
+#define SPIKE_SHARE  2                   /* ... or bytes freed since then, this fraction of the arena's heap */
+
+#define MAX_ARENAS   8                   /* most arenas mm_set_arenas takes */
+#define SEG_MIN      (16 * SLAB_SIZE)    /* smallest new segment with more than one arena (bytes) */
+
+#define REGION_CHUNK (1 << 12)           /* default chunk of a region, header included (bytes) */
+#define REGION_BIG   4                   /* requests over chunk/this get a chunk of their own */
+#define POOL_CHUNK   (1 << 12)           /* a pool asks for chunks of this many bytes at least */
+#define POOL_MIN     8                   /* objects in a pool chunk at least */
+#define HCHUNK       (1 << 12)           /* the movable heap grows by at least this (bytes) */
+#define HSTEP        (1 << 12)           /* bytes the compactor moves per handle call */
+#define HGROW        16                  /* ... and per byte the movable heap would grow by */
+#define HSLOTS       (4096 / sizeof(hslot_t)) /* first size of the handle table, a page */
+
+#define GROW_MAX     (1 << 16)           /* default biggest growth step (bytes) */
+#define GROW_RAMP    4                   /* default bytes placed per byte freed that make a ramp */
+#define GROW_REQS    8                   /* a ramping step holds at least this many recent requests */
+#define GROW_SHARE   8                   /* a step is at most this fraction of the arena's heap */
+
+#define TCACHE_MAX   (1 << 10)           /* blocks up to this size go in the thread caches (bytes) */
+#define TCACHE_BINS  (SLAB_CLASSES + TCACHE_MAX/DSIZE + 1) /* slab classes, then one bin per block size */
+#define TCACHE_COUNT 16                  /* most blocks a thread keeps in one bin */
 
 /* changed macros to inline functions because Freysteinn
  * recommended it 😊 */
 
-inline size_t MAX(int x, int y){
+static inline size_t MAX(size_t x, size_t y){
 	return ((x) > (y) ? (x) : (y));
 }
 
-/* Pack a size and allocated bit into a word */
-inline size_t PACK(size_t size, size_t alloc){
+/* Pack a size and allocated bits into a word */
+static inline size_t PACK(size_t size, size_t alloc){
 	return ((size) | (alloc));
 }
 
-/* Read and write a word at address p. */
-inline size_t GET(char *p){
-	return (*(size_t*)(p));
+/* Read and write a word at address p.
+ * Relaxed atomics so a thread caching or remote freeing a block can read
+ * its size while the arena's lock holder flips its prev allocated bit,
+ * they are plain loads and stores on every machine we run on. */
+static inline size_t GET(char *p){
+	return __atomic_load_n((size_t *)(p), __ATOMIC_RELAXED);
 }
-inline size_t PUT(char *p, size_t val){
-	return (*(size_t *)(p) = (val));
+static inline size_t PUT(char *p, size_t val){
+	__atomic_store_n((size_t *)(p), val, __ATOMIC_RELAXED);
+	return val;
 }
 
 
 /* Read the size and allocated fields from address p */
-inline size_t GET_SIZE(char *p) {
+static inline size_t GET_SIZE(char *p) {
     return (GET(p) & ~0x7);
 }
-inline size_t GET_ALLOC(char *p) {
-    return (GET(p) & 0x1);
+static inline size_t GET_ALLOC(char *p) {
+    return (GET(p) & ALLOC);
+}
+static inline size_t GET_PREV_ALLOC(char *p) {
+    return (GET(p) & PREV_ALLOC);
+}
+
+/* Set and clear the previous block allocated bit of the header at p */
+static inline void SET_PREV_ALLOC(char *p) {
+    PUT(p, GET(p) | PREV_ALLOC);
+}
+static inline void CLR_PREV_ALLOC(char *p) {
+    PUT(p, GET(p) & ~(size_t)PREV_ALLOC);
 }
 
 
-/* Given block ptr bp, compute address of its header and footer */
-inline char* HDRP(char* bp) {
+/* Given block ptr bp, compute address of its header and footer (free blocks only) */
+static inline char* HDRP(char* bp) {
     return ((char*)(bp) - WSIZE);
 }
-inline char* FTRP(char* bp) {
+static inline char* FTRP(char* bp) {
     return ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE);
 }
 
 
-/*Given block ptr bp, compute address of next and previous blocks */
-inline char* NEXT_BLKP(char* bp) {
+/*Given block ptr bp, compute address of next and previous blocks
+ * PREV_BLKP only works when the previous block is free, it reads its footer */
+static inline char* NEXT_BLKP(char* bp) {
     return ((char*)(bp) + GET_SIZE(((char*)(bp) - WSIZE)));
 }
-inline char* PREV_BLKP(char* bp) {
+static inline char* PREV_BLKP(char* bp) {
     return ((char*)(bp) - GET_SIZE(((char*)(bp) - DSIZE)));
 }
 
@@ -144,10 +449,142 @@ inline char* PREV_BLKP(char* bp) {
 #define NEXT_FREE(bp)  (*(char **)(bp + WSIZE)) 
 #define PREV_FREE(bp)  (*(char **)(bp)) 
 
+/* Given free ptr bp of a block in the tree, its children and
+ * its neighbours in the chain of blocks with the same size */
+#define TREE_LEFT(bp)   (*(char **)(bp))
+#define TREE_RIGHT(bp)  (*(char **)((char *)(bp) + WSIZE))
+#define CHAIN_NEXT(bp)  (*(char **)((char *)(bp) + 2*WSIZE))
+#define CHAIN_PREV(bp)  (*(char **)((char *)(bp) + 3*WSIZE))
+
 
 /* Global declarations */
-static char *heap_listp = 0; /* pointer to the first block */
-static char *free_listp = 0; /*pointer to the beginning of our free list */
+/* Placement policy, these survive mm_init */
+static int fit_policy = MM_FIRST_FIT;     /* one of the MM_xxx_FIT constants in mm.h */
+static int good_probes = 8;               /* good fit gives up after this many blocks */
+static size_t good_slack = 4*DSIZE;       /* good fit takes a block that wastes no more than this */
+static int deferred = 0;                  /* use the quick lists (mm_set_deferred) */
+static size_t mmap_threshold = HUGE_MIN;  /* requests this big get a mapping, 0 for never */
+static size_t grow_min = CHUNKSIZE;       /* smallest growth step (mm_set_growth) */
+static size_t grow_max = GROW_MAX;        /* biggest growth step */
+static unsigned grow_ramp = GROW_RAMP;    /* bytes placed per byte freed that double the step */
+
+/* The header at the start of every slab page */
+typedef struct slab {
+    struct slab *next;          /* next slab of this class with free objects */
+    struct slab *prev;          /* previous slab of this class with free objects */
+    unsigned short cls;         /* slab class, objects are (cls+1)*DSIZE bytes */
+    unsigned short nobjs;       /* number of objects in the slab */
+    unsigned short nfree;       /* number of free objects */
+    unsigned short hint;        /* bitmap word to start looking for a free object */
+    unsigned int used[SLAB_WORDS]; /* bit i set iff object i is allocated */
+} slab_t;
+
+/* first object of a slab, right after the header */
+#define SLAB_OBJS(sp) ((char *)(sp) + DSIZE * ((sizeof(slab_t) + DSIZE - 1) / DSIZE))
+
+static unsigned char page_map[MAX_HEAP / SLAB_SIZE + 1]; /* PAGE_SLAB for heap pages that are slabs */
+static unsigned char arena_map[MAX_HEAP / SLAB_SIZE + 1]; /* arena that owns each heap page */
+static unsigned short block_map[MAX_HEAP / SLAB_SIZE + 1]; /* a block on each heap page, see check_touched */
+static unsigned char list_map[(MAX_HEAP / SLAB_SIZE + 1) * (SLAB_SIZE / DSIZE / 8)]; /* mm_check's mark of every free block it found on a list */
+static size_t page_map_hi = 0;            /* highest heap page so far, the maps are clear above it */
+static int touch_on = 0;                  /* arenas log what they touch, mm_check_touched was called */
+
+/* A block realloc has grown, in the grow table of its arena */
+typedef struct {
+    char *bp;                   /* the block, NULL if the slot is free */
+    unsigned grows;             /* how many times it grew */
+    size_t req;                 /* size asked for at the last realloc (bytes) */
+} grow_t;
+
+/* An independent heap, everything in it is guarded by its lock */
+typedef struct {
+    pthread_mutex_t lock;
+    char *segs;                           /* its newest segment, see the heap picture */
+    char *brk;                            /* end of its newest segment */
+    char *seg_lists[NUM_CLASSES];         /* heads of our segregated free lists */
+#if USE_TLSF
+    unsigned long fl_bitmap;              /* bit f set if some list in first level f is non empty */
+    unsigned int sl_bitmap[FL_COUNT];     /* bit s of entry f set if list (f, s) is non empty */
+#else
+    char *tree_root;                      /* root of the tree of large free blocks */
+    char *rovers[NUM_CLASSES];            /* where the last next fit search of each class ended */
+#endif
+    slab_t *slab_lists[SLAB_CLASSES];     /* slabs with free objects, per class */
+    char *quick[QUICK_BINS];              /* deferred free blocks of each size, still marked allocated */
+    int quick_len[QUICK_BINS];            /* blocks on each quick list */
+    int quick_total;                      /* blocks on all quick lists */
+    grow_t grows[GROW_SLOTS];             /* blocks realloc is watching grow */
+    unsigned quiet;                       /* frees since the arena last extended the heap */
+    size_t placed;                        /* bytes handed out since then */
+    size_t freed;                         /* bytes freed since then */
+    size_t req;                           /* running average of the last requests, see grow_size */
+    size_t step;                          /* what the heap grew by last time, see grow_size */
+    size_t heap;                          /* bytes of heap the arena got and didn't trim */
+    char *fresh;                          /* never handed out from here to brk, see calloc above */
+    char *touched[TOUCH_LOG];             /* blocks that went on or off a free list since the last check */
+    int ntouched;                         /* how many, more than TOUCH_LOG once they didn't fit */
+    mm_counts_t counts;                   /* splits, merges, ... (mm_get_counts) */
+    char *remote_frees __attribute__((aligned(64))); /* blocks other threads freed, not locked */
+} __attribute__((aligned(64))) arena_t;
+
+static arena_t arenas[MAX_ARENAS] = {
+    [0 ... MAX_ARENAS-1] = { .lock = PTHREAD_MUTEX_INITIALIZER }
+};
+static int num_arenas = 1;                /* arenas in use since the last mm_init */
+static int want_arenas = 1;               /* arenas the next mm_init sets up */
+static int next_arena = 0;                /* round robin counter for new threads */
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER; /* guards mem_sbrk and the maps */
+static __thread arena_t *arena;           /* arena the do_ functions work on */
+
+/* A region, it lives in a block of the heap like its chunks */
+struct mm_region {
+    char *chunks;                 /* newest chunk, each links to the one before */
+    char *next;                   /* where the next object in the newest chunk goes */
+    char *end;                    /* end of the newest chunk */
+    size_t chunk;                 /* what a chunk asks mm_malloc for (bytes) */
+};
+
+/* A pool, in a block of the heap too */
+struct mm_pool {
+    char *free;                   /* stack of free objects */
+    char *chunks;                 /* newest chunk, each links to the one before */
+    size_t size;                  /* object size, a multiple of align (bytes) */
+    size_t align;                 /* object alignment, at least DSIZE */
+};
+
+/* A thread's cache of freed blocks, linked through their first word */
+typedef struct {
+    unsigned epoch;               /* heap_epoch these blocks belong to */
+    int registered;               /* has this thread been counted yet */
+    int arena_no;                 /* this thread's arena is arena_no % num_arenas */
+    char *bins[TCACHE_BINS];      /* cached blocks, one list per size */
+    unsigned char counts[TCACHE_BINS]; /* number of blocks in each list */
+} tcache_t;
+
+/* A slot of the handle table */
+typedef struct {
+    char *bp;                     /* payload of the block, next free slot when the slot is free */
+    unsigned locks;               /* mm_hlock count, a locked block doesn't move */
+} hslot_t;
+
+/* The movable heap and its handles, all under handle_lock */
+static pthread_mutex_t handle_lock = PTHREAD_MUTEX_INITIALIZER;
+static hslot_t *hslots = NULL;            /* handle table, slot 0 is no handle */
+static size_t hslots_cap = 0;             /* slots in the table */
+static size_t hslots_used = 0;            /* slots below this were handed out before */
+static size_t hslot_free = 0;             /* first free slot, 0 for none */
+static char *htop;                        /* end of the last movable block */
+static char *hend;                        /* end of the movable heap */
+static char *hdense;                      /* the sweep left no gap below here */
+static char *hscan;                       /* where it goes on, hdense..hscan is free */
+static char *hhole = NULL;                /* lowest block freed below hdense, the next sweep starts there */
+static char *hskipped = NULL;             /* lowest gap the sweep left in front of a locked block */
+
+static unsigned heap_epoch = 0;           /* bumped by every mm_init */
+static int threads_seen = 0;              /* threads that have called us, caches are on from 2 */
+static pthread_key_t tcache_key;          /* only there so exiting threads flush their cache */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static __thread tcache_t tcache;          /* this thread's cache */
 
 
 /* Function prototypes for internal helper routines */
@@ -155,513 +592,3737 @@ static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
-static void checkblock(void *bp);
+static int checkblock(void *bp);
 static void printblock(void *bp); 
 int mm_check();
+static int check_heap(void);
+static int check_handles(void);
+static int check_segment(char *heap_listp);
+static int check_touched(void);
+static int check_block(char *bp, int marked);
+static int mark_lists(int on);
+static inline int list_marked(char *bp);
+static inline void list_mark(char *bp, int on);
+static int listed(char *bp);
+static inline void touch(char *bp);
+static inline void block_note(char *bp);
+static inline char *block_on(size_t page);
 static void insertBlock(void *bp);
 static void removeBlock(void *bp);
 static size_t adjust_and_align(size_t size);
 static void *find_best_fit(size_t asize);
+static void *find_block(size_t asize);
+#if !USE_TLSF
+static void *find_next_fit(size_t asize);
+static void *find_good_fit(size_t asize);
+#endif
+static int size_class(size_t size);
+#if USE_TLSF
+static inline int fls_size(size_t size);
+static inline void tlsf_mapping(size_t size, int *fl, int *sl);
+#else
+static char *splay(char *t, size_t size);
+static void tree_insert(char *bp);
+static void tree_remove(char *bp);
+static void *tree_best_fit(size_t asize);
+static int tree_check(char *t, size_t lo, size_t hi);
+static int tree_contains(char *bp);
+static int tree_mark(char *t, int on);
+#endif
+static void *alloc_aligned(size_t align, size_t asize);
+static void *slab_alloc(size_t size);
+static void slab_free(void *bp);
+static inline int is_slab(void *bp);
+static inline slab_t *slab_of(void *bp);
+static void *do_malloc(size_t size);
+static void *do_calloc(size_t bytes);
+static inline void used(char *bp);
+static size_t grow_size(size_t asize);
+static void fresh_grow(char *bp, char *merged, char *clean, int seg);
+static void do_free(void *bp);
+static void *do_realloc(void *ptr, size_t size);
+static void *tcache_get(size_t size);
+static int tcache_put(void *bp);
+static int tcache_put_sized(void *bp, size_t size);
+static inline int tcache_ready(void);
+static char *new_segment(void);
+static void map_pages(char *lo, char *hi);
+static inline size_t heap_page(void *bp);
+static inline arena_t *arena_of(void *bp);
+static inline arena_t *my_arena(void);
+static void arena_reset(arena_t *a);
+static int at_heap_end(char *bp);
+static void push_remote_free(arena_t *a, char *bp);
+static void drain_remote_frees(void);
+static void lock_arenas(void);
+static void free_block(void *bp);
+static void free_block_size(void *bp, size_t size);
+static void do_free_sized(void *bp, size_t size);
+static void check_sized(void *bp, size_t size);
+static int trim_heap(char *bp);
+static void release_pages(char *bp, char *lo, char *hi, int now);
+static void trim_block(void *bp, size_t asize);
+static void *grow_backward(void *bp, size_t asize);
+static grow_t *grow_find(char *bp);
+static grow_t *grow_track(char *bp);
+static void grow_forget(char *bp);
+static void grow_move(grow_t *g, char *bp);
+static size_t grow_want(grow_t *g, size_t size, size_t asize);
+static inline int is_huge(void *bp);
+static inline int is_huge_size(size_t size);
+static void *huge_alloc(size_t size);
+static void *huge_alloc_aligned(size_t align, size_t size);
+static inline char *huge_base(void *bp);
+static void huge_free(void *bp);
+static void *huge_realloc(void *bp, size_t size);
+static void quick_push(void *bp);
+static void *quick_pop(size_t asize);
+static void quick_flush(void);
+static void *find_or_flush(size_t asize);
+static void unlock_arenas(void);
+static int do_malloc_batch(size_t size, int n, void **out);
+static int carve(void *bp, size_t asize, int n, void **out);
+static void free_run(void **p, int k);
+static int ptr_cmp(const void *a, const void *b);
+static void *region_grow(mm_region_t *r, size_t size);
+static void *pool_grow(mm_pool_t *p);
+static void handles_reset(void);
+static int hcompact(size_t budget);
+static void hgap_close(void);
+static inline void hhole_note(char *b);
 /*
  * mm_init - Initialize the memory manager
  */
 /* $begin mminit */
 int mm_init(void) {
   
-    /* Create the initial empty heap. */
-    if ((heap_listp = mem_sbrk(8*WSIZE)) == NULL) 
-        return -1;
+    int i, ok;
 
-    PUT(heap_listp, 0);                            /* Alignment padding */
-    PUT(heap_listp +  WSIZE,  PACK(OVERHEAD, 1));  /* Prologue header */ 
-    PUT(heap_listp + DSIZE, PACK(OVERHEAD, 1));    /* Prologue footer */ 
-    PUT(heap_listp + DSIZE+WSIZE, PACK(0, 1));     /* Epilogue header */
-  
-    /* initialize our free list pointer */
-    free_listp = heap_listp + DSIZE; 
-
-    /* mm-firstfit extended the heap with CHUNKSIZE bytes but we found we got better score for util
-     * when we extended it by a smaller size at the beginning.
-     * We tested a lot of different sizes and in the end found that 32 words were large enough
-     * while not lowering our util score */
-    if (extend_heap(DSIZE*WSIZE) == NULL){ 
-        return -1;
+    lock_arenas();
+    /* blocks cached from the old heap must never come back */
+    __atomic_store_n(&heap_epoch, heap_epoch + 1, __ATOMIC_RELAXED);
+
+    /* every arena starts out without memory and with empty lists,
+     * it gets its first segment the first time it has to grow */
+    num_arenas = want_arenas;
+    for (i = 0; i < MAX_ARENAS; i++) {
+        arena_reset(&arenas[i]);
     }
-    return 0;
+
+    /* forget the slab pages and owners of the last heap */
+    memset(page_map, 0, page_map_hi + 1);
+    memset(arena_map, 0, page_map_hi + 1);
+    memset(block_map, 0, (page_map_hi + 1) * sizeof(block_map[0]));
+    memset(list_map, 0, (page_map_hi + 1) * (SLAB_SIZE / DSIZE / 8));
+    page_map_hi = 0;
+
+    /* the first segment is a fixed DSIZE*WSIZE words (1 KB, 128 bytes on
+     * 32 bit), not a grow_size step, every extension after it goes through
+     * grow_size. It decides where the first blocks of a trace land and the
+     * short default traces are very touchy about that: seeding with
+     * grow_min (4 KB) takes coalescing from 88% to 66% util, 512 bytes
+     * takes realloc from 89% to 20%. So -G doesn't change it */
+    arena = &arenas[0];
+    ok = extend_heap(DSIZE*WSIZE) != NULL;
+    unlock_arenas();
+    /* not under the arena locks, mm_halloc takes those without handle_lock */
+    handles_reset();
+    return ok ? 0 : -1;
 }
 /* $end mminit */
 
 /*
  * mm_malloc - Allocate a block with at least size bytes of payload
- *             
- * We start by adjusting and aligning our size to include overhead and alignment
- * requirements. Then we try to find a fit for our block, if we do we place our block 
- * where it fits. 
- * If no fit is found we extend the heap and then place our block.
+ *             from the thread cache if it has one, otherwise from the heap
  */
-/* $begin mmalloc */
-void *mm_malloc(size_t size) 
+void *mm_malloc(size_t size)
 {
-    size_t asize;      /* Adjusted block size */
-    size_t extendsize; /* Amount to extend heap if no fit */
     void *bp;
+    arena_t *a;
 
-    /* Ignore spurious requests. */
-    if (size == 0){
+    if (size == 0) {
         return NULL;
-	}
-    /* Adjust block size to include overhead and alignment reqs. */
-    asize = adjust_and_align(size);
+    }
+    if (is_huge_size(size)) {
+        return huge_alloc(size);
+    }
+    if ((bp = tcache_get(size)) != NULL) {
+        return bp;
+    }
+    a = my_arena();
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    if (__atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED) != NULL) {
+        drain_remote_frees();
+    }
+    bp = do_malloc(size);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
+}
 
-    /* Search the free list for a fit. */
-    if ((bp = find_fit(asize)) != NULL) {
-        place(bp, asize);
-		return bp;
-	}
+/*
+ * mm_calloc - Allocate a block for nmemb elements of size bytes with every
+ *      byte zero, or NULL if that many bytes don't fit in a size_t.
+ *      Huge blocks are fresh mappings and zero already, a block from the
+ *      thread cache is cleared whole, see do_calloc for the rest.
+ */
+void *mm_calloc(size_t nmemb, size_t size)
+{
+    void *bp;
+    arena_t *a;
+    size_t bytes;
 
-    /* No fit found.  Get more memory and place the block. */
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL){  
-		return NULL;
-	}
-    
-    place(bp, asize);
-	return bp;
-} 
-/* $end mmalloc */
+    if (nmemb == 0 || size == 0 || nmemb > (size_t)-1 / size) {
+        return NULL;
+    }
+    bytes = nmemb * size;
+    if (is_huge_size(bytes)) {
+        return huge_alloc(bytes);
+    }
+    if ((bp = tcache_get(bytes)) != NULL) {
+        memset(bp, 0, bytes);
+        return bp;
+    }
+    a = my_arena();
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    if (__atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED) != NULL) {
+        drain_remote_frees();
+    }
+    bp = do_calloc(bytes);
+    pthread_mutex_unlock(&a->lock);
+    return bp;
+}
 
 /*
- * mm_free - Free a block
- * Same implementation as with implicit list.
- * We get the size, put it into the header and 
- * footer and coalesce where the block is inserted
- * into the free list.
+ * mm_free - Free a block, into the thread cache if there is room
+ *           and otherwise back to the arena that owns it, through its
+ *           remote free queue if that is not our arena
  */
-/* $begin mmfree */
-void mm_free(void *bp){
-    size_t size =  GET_SIZE(HDRP(bp));
+void mm_free(void *bp)
+{
+    arena_t *a;
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    if (bp == NULL) {
+        return;
+    }
+    if (is_huge(bp)) {
+        huge_free(bp);
+        return;
+    }
+    if (tcache_put(bp)) {
+        return;
+    }
+    a = arena_of(bp);
+    if (a != my_arena()) {
+        push_remote_free(a, bp);
+        return;
+    }
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    do_free(bp);
+    pthread_mutex_unlock(&a->lock);
 }
 
 /*
- * mm_realloc - Reallocates pointer ptr with size bytes.
- * We start with adjusting the size to meet our requirements.
- * We have some special cases to increase performance but if
- * none of that works we just simply malloc a new block
- * and free the old block. 
+ * mm_free_sized - mm_free for a caller that still knows the size it asked
+ *      for (the size of the malloc, or of the last realloc of bp), like a
+ *      C++ sized delete. See do_free_sized for what that buys.
+ *      Built with CHECK_SIZED it first checks that size fits the block.
  */
-void *mm_realloc(void *ptr, size_t size){
-    void *newp;
-    size_t copySize, asize, nextSize, extendSize;
-    asize = adjust_and_align(size);
+void mm_free_sized(void *bp, size_t size)
+{
+    arena_t *a;
 
-    /* if ptr is NULL it is the same as calling mm_malloc(size) */
-    if(ptr == NULL) {
-        return mm_malloc(size);
+    if (bp == NULL) {
+        return;
     }
-
-    /* if size is 0 it is the same as calling mm_free(ptr) */
-    else if(size == 0) {
-        mm_free(ptr);
-        return 0;
+    if (CHECK_SIZED) {
+        check_sized(bp, size);
     }
-    
-    copySize = GET_SIZE(HDRP(ptr)); //size of the block pointed to by ptr */
-    
-    /* if adjusted size is same as current ptr, just return ptr */
-    if (asize == copySize) {
-        return ptr;
+    if (is_huge(bp)) {
+        huge_free(bp);
+        return;
+    }
+    if (size >= SLAB_MAX ? tcache_put_sized(bp, size) : tcache_put(bp)) {
+        return;
+    }
+    a = arena_of(bp);
+    if (a != my_arena()) {
+        push_remote_free(a, bp);
+        return;
     }
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    do_free_sized(bp, size);
+    pthread_mutex_unlock(&a->lock);
+}
 
+/*
+ * mm_memalign - Allocate a block with at least size bytes of payload that
+ *      starts at a multiple of align (a power of two). Returns NULL for an
+ *      align that is not a power of two. The gap in front of the payload
+ *      goes back to the free lists as a block of its own, see alloc_aligned.
+ *      A huge request gets a mapping with the payload align bytes in, up
+ *      to a page, bigger aligns come from the heap.
+ */
+void *mm_memalign(size_t align, size_t size)
+{
+    void *bp;
+    arena_t *a;
 
-    /* Special Cases -
-        next block is free and big enough
-        next block is free but not big enough but is at the end
-        our ptr block is the last block
-    */
-    nextSize = GET_SIZE(HDRP(NEXT_BLKP(ptr))); //size of the next block
-    
-    /*Case 1 -  check if next block is free and big enough */
-    if(!GET_ALLOC(HDRP(NEXT_BLKP(ptr))) && nextSize + copySize >= asize) {
-        removeBlock(NEXT_BLKP(ptr));
-        PUT(HDRP(ptr), PACK(nextSize+copySize, 1));
-        PUT(FTRP(ptr), PACK(nextSize+copySize, 1));
-        return ptr;
+    if (align == 0 || (align & (align - 1)) != 0) {
+        return NULL;
     }
-    /*Case 2 - check if next block is free and the last block */
-    else if(!GET_ALLOC(HDRP(NEXT_BLKP(ptr))) && GET_SIZE(HDRP(NEXT_BLKP(NEXT_BLKP(ptr))))  == 0) {
-        extendSize = MAX(asize - (copySize + nextSize), CHUNKSIZE);
-        newp = extend_heap(extendSize/WSIZE);
-        removeBlock(NEXT_BLKP(ptr));
-        nextSize = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        PUT(HDRP(ptr), PACK(nextSize+copySize,1));
-        PUT(FTRP(ptr), PACK(nextSize+copySize,1));
-        return ptr;
+    if (align <= DSIZE) {
+        return mm_malloc(size);
     }
-    /* Case 3 - check if current block is at the end */
-    else if(nextSize == 0) {
-        extendSize = MAX(asize - copySize, CHUNKSIZE);
-        newp = extend_heap(extendSize/WSIZE);
-        removeBlock(NEXT_BLKP(ptr));
-        nextSize = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
-        PUT(HDRP(ptr), PACK(nextSize+copySize,1));
-        PUT(FTRP(ptr), PACK(nextSize+copySize,1));    
-        return ptr;
+    if (size == 0) {
+        return NULL;
     }
+    if (is_huge_size(size) && align <= mem_pagesize()) {
+        return huge_alloc_aligned(align, size);
+    }
+    a = my_arena();
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    if (__atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED) != NULL) {
+        drain_remote_frees();
+    }
+    bp = alloc_aligned(align, adjust_and_align(size));
+    pthread_mutex_unlock(&a->lock);
+    return bp;
+}
 
+/*
+ * mm_malloc_sized - mm_malloc that also tells how many bytes the block
+ *      can really hold (mm_usable_size) in *actual, 0 if it failed
+ */
+void *mm_malloc_sized(size_t size, size_t *actual)
+{
+    void *bp = mm_malloc(size);
 
-    /* if nothing above works, we just malloc a new block and return it */
-    if((newp = mm_malloc(size)) == NULL) {
-        printf("ERROR: mm_malloc failed in mm_realloc\n");
-        exit(1);
+    if (actual != NULL) {
+        *actual = mm_usable_size(bp);
     }
+    return bp;
+}
 
-    if(size < copySize) {
-        copySize = size;
+/*
+ * mm_usable_size - How many bytes the allocated block bp can hold, 0 for
+ *      NULL. That is at least what it was asked for, often more: sizes are
+ *      rounded up, a remainder too small to be a block stays with the block
+ *      and realloc gives slack to blocks that keep on growing. The caller
+ *      can use all of it. No lock, only the owner of bp changes its size.
+ */
+size_t mm_usable_size(void *bp)
+{
+    if (bp == NULL) {
+        return 0;
+    }
+    if (is_huge(bp)) {
+        return GET_SIZE(HDRP(bp)) - ((char *)bp - huge_base(bp));
     }
+    if (is_slab(bp)) {
+        return (slab_of(bp)->cls + 1) * DSIZE;
+    }
+    return GET_SIZE(HDRP(bp)) - OVERHEAD;
+}
 
-    memcpy(newp, ptr, copySize);
-    mm_free(ptr);
+/*
+ * mm_realloc - Reallocate ptr to size bytes, see do_realloc
+ *              The block stays in the arena that owns it.
+ *              Huge blocks don't belong to an arena, see huge_realloc.
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    void *newp;
+    arena_t *a;
+
+    if (ptr != NULL && is_huge(ptr)) {
+        if (size == 0) {
+            huge_free(ptr);
+            return NULL;
+        }
+        return huge_realloc(ptr, size);
+    }
+    a = ptr != NULL ? arena_of(ptr) : my_arena();
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    newp = do_realloc(ptr, size);
+    pthread_mutex_unlock(&a->lock);
     return newp;
-    
 }
 
 /*
- * Checks the heap for consistency. Returns a nonzero value if and only if
- * the heap is consistent.
- * Checks if
- *     The prologue/epilogue headers are right
- *     The headers match the footers
- *     Every block in the free list is marked as free
- *     Adjacent free blocks should have been coalesced
- *     Every free block is actually in the free list
+ * mm_malloc_batch - Allocate n blocks of size bytes each into out[0..n-1]
+ *      under one lock and, as far as possible, out of one free block.
+ *      Returns how many it got, fewer than n only if we ran out of memory.
+ *      The blocks don't come from the thread cache.
  */
-int mm_check(void) {
-    char *bp;
-    int is_good = 1;
-    /*
-     *Checks the prologue header. If it is not of size 8 or is not allocated
-     *it is not right
-    */
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp))) {
-        printf("Bad prologue header\n");
-        is_good = 0;
+int mm_malloc_batch(size_t size, int n, void **out)
+{
+    int got = 0;
+    arena_t *a;
+
+    if (size == 0 || n <= 0) {
+        return 0;
+    }
+    if (is_huge_size(size)) {
+        while (got < n && (out[got] = huge_alloc(size)) != NULL) {
+            got++;
+        }
+        return got;
+    }
+    a = my_arena();
+    pthread_mutex_lock(&a->lock);
+    arena = a;
+    if (__atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED) != NULL) {
+        drain_remote_frees();
     }
+    got = do_malloc_batch(size, n, out);
+    pthread_mutex_unlock(&a->lock);
+    return got;
+}
 
-    /*
-     *runs through every block on the heap and checks if
-     *   we are doubleword aligning
-     *   a free block is in our free list
-     *   there are adjacent free blocks that need to be coalesced
-     *   
-    */
+/*
+ * mm_free_batch - Free the n blocks in ptrs (NULLs are skipped)
+ *      ptrs is sorted by address in place. Then every run of blocks that
+ *      lie right after each other in the heap is made into one free block
+ *      and coalesced with its neighbours once, instead of once per block.
+ *      An arena is locked once per run of its blocks, not once per block.
+ */
+void mm_free_batch(void **ptrs, int n)
+{
+    arena_t *a = NULL, *b;
+    int i, j;
 
-    for(bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
-        if((size_t)bp % 8) {
-            printf("Error: %p is not doubleword aligned\n", bp);
-            is_good = 0;
+    if (n <= 0) {
+        return;
+    }
+    qsort(ptrs, n, sizeof(void *), ptr_cmp);
+    for (i = 0; i < n; i = j) {
+        j = i + 1;
+        if (ptrs[i] == NULL) {
+            continue;
         }
-        /* if we find a free block, we traverse the free list to see if it is in the list */
-        if(!GET_ALLOC(HDRP(bp))){
-            char* temp_ptr;
-            int found = 0;
-            for(temp_ptr = free_listp; GET_ALLOC(HDRP(temp_ptr)) == 0; temp_ptr = NEXT_FREE(temp_ptr)){
-                if(temp_ptr == bp){
-					found = 1;
-					break;
-                }
-            }
-            if(!found) {
-                printf("Block %p is not in the free list", bp);
-                is_good = 0;
+        if (is_huge(ptrs[i])) {
+            huge_free(ptrs[i]);
+            continue;
+        }
+        if ((b = arena_of(ptrs[i])) != a) {
+            if (a != NULL) {
+                pthread_mutex_unlock(&a->lock);
             }
+            a = b;
+            pthread_mutex_lock(&a->lock);
+            arena = a;
+        }
+        if (is_slab(ptrs[i])) {
+            slab_free(ptrs[i]);
+            continue;
+        }
+        while (j < n && ptrs[j] == NEXT_BLKP(ptrs[j - 1])) {
+            j++;
         }
+        free_run(ptrs + i, j - i);
+    }
+    if (a != NULL) {
+        pthread_mutex_unlock(&a->lock);
     }
-
-    /*
-     *Checks the epilogue header. If it is not of size 0 and not allocated
-     *it is not right
-     */
-     if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {
-         printf("Bad epilogue header\n");
-         is_good = 0;
-     }
-
-
-     /*
-      *     Check if every block in our free list is actually free.
-      *
-      */
-
-     for(bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREE(bp)){
-        if(GET_ALLOC(bp)){
-            printf("Block %p in free list is actually not free", bp);    
-            is_good = 0;
-         }
-     }
-
-     return is_good;
-
 }
 
-
-/* The remaining routines are internal helper routines */
-
 /*
- * extend_heap - Extend heap with free block and return its pointer
+ * mm_region_create - A new empty region whose chunks are chunk bytes,
+ *      0 for REGION_CHUNK. NULL if we are out of memory.
+ *      A region is not locked, only one thread may use it at a time.
  */
-/* $begin mmextendheap */
-static void *extend_heap(size_t words) {
+mm_region_t *mm_region_create(size_t chunk)
+{
+    mm_region_t *r;
+
+    if ((r = mm_malloc(sizeof(*r))) == NULL) {
+        return NULL;
+    }
+    r->chunks = r->next = r->end = NULL;
+    r->chunk = chunk > 0 ? chunk : REGION_CHUNK - OVERHEAD;
+    return r;
+}
+
+/*
+ * mm_region_alloc - size bytes out of region r, DSIZE aligned.
+ *      Bumps the pointer of the newest chunk if they fit there,
+ *      region_grow gets a new chunk if not. NULL if out of memory.
+ */
+void *mm_region_alloc(mm_region_t *r, size_t size)
+{
+    char *bp;
+
+    size = (size + DSIZE-1) & ~(size_t)(DSIZE-1);
+    if (size == 0) {
+        return NULL;
+    }
+    if (size <= (size_t)(r->end - r->next)) {
+        bp = r->next;
+        r->next += size;
+        return bp;
+    }
+    return region_grow(r, size);
+}
+
+/*
+ * mm_region_reset - Give up every object of region r at once
+ *      All chunks but the newest go back to the heap, the next objects
+ *      start at the beginning of that one again.
+ */
+void mm_region_reset(mm_region_t *r)
+{
+    char *c, *prev;
+
+    if (r->chunks == NULL) {
+        return;
+    }
+    for (c = *(char **)r->chunks; c != NULL; c = prev) {
+        prev = *(char **)c;
+        mm_free(c);
+    }
+    *(char **)r->chunks = NULL;
+    r->next = r->chunks + DSIZE;
+    r->end = r->chunks + mm_usable_size(r->chunks);
+}
+
+/*
+ * mm_region_destroy - Free region r with all of its chunks
+ */
+void mm_region_destroy(mm_region_t *r)
+{
+    char *c, *prev;
+
+    if (r == NULL) {
+        return;
+    }
+    for (c = r->chunks; c != NULL; c = prev) {
+        prev = *(char **)c;
+        mm_free(c);
+    }
+    mm_free(r);
+}
+
+/*
+ * mm_pool_create - A pool of objects of size bytes aligned to align (a
+ *      power of two, 0 for DSIZE). NULL if align isn't one or we are out
+ *      of memory. A pool is not locked, one thread at a time may use it.
+ */
+mm_pool_t *mm_pool_create(size_t size, size_t align)
+{
+    mm_pool_t *p;
+
+    if (align < DSIZE) {
+        align = DSIZE;
+    }
+    if ((align & (align - 1)) != 0 || size == 0 || size > MAX_HEAP) {
+        return NULL;
+    }
+    if ((p = mm_malloc(sizeof(*p))) == NULL) {
+        return NULL;
+    }
+    p->free = p->chunks = NULL;
+    p->size = (size + align-1) & ~(align-1);
+    p->align = align;
+    return p;
+}
+
+/*
+ * mm_pool_get - An object from pool p, NULL if out of memory
+ */
+void *mm_pool_get(mm_pool_t *p)
+{
+    char *bp = p->free;
+
+    if (bp == NULL) {
+        return pool_grow(p);
+    }
+    p->free = *(char **)bp;
+    return bp;
+}
+
+/*
+ * mm_pool_put - Give object bp back to pool p, the pool it came from
+ */
+void mm_pool_put(mm_pool_t *p, void *bp)
+{
+    *(char **)bp = p->free;
+    p->free = bp;
+}
+
+/*
+ * mm_pool_destroy - Free pool p and all of its chunks, objects still out
+ *      go with them
+ */
+void mm_pool_destroy(mm_pool_t *p)
+{
+    char *c, *prev;
+
+    if (p == NULL) {
+        return;
+    }
+    for (c = p->chunks; c != NULL; c = prev) {
+        prev = *(char **)c;
+        mm_free(c);
+    }
+    mm_free(p);
+}
+
+/*
+ * mm_halloc - A movable block of size bytes, returns its handle or 0 if
+ *      we are out of memory. mm_hlock gives a pointer to it.
+ */
+mm_handle_t mm_halloc(size_t size)
+{
+    size_t asize, h, cap, grow;
+    hslot_t *t;
+    char *b;
+
+    if (size == 0 || size > MAX_HEAP) {
+        return 0;
+    }
+    asize = (size + DSIZE + DSIZE-1) & ~(size_t)(DSIZE-1);
+    pthread_mutex_lock(&handle_lock);
+    hcompact(HSTEP);
+
+    /*
+     * A slot for the handle, the table doubles when it is full. The table
+     * is a mapping of memlib's that grows with mem_remap, no arena lock is
+     * ever taken under handle_lock.
+     */
+    if (hslot_free == 0 && hslots_used == hslots_cap) {
+        cap = hslots_cap > 0 ? 2 * hslots_cap : HSLOTS;
+        t = hslots != NULL ? mem_remap(hslots, cap * sizeof(hslot_t))
+                           : mem_map(cap * sizeof(hslot_t));
+        if (t == NULL) {
+            pthread_mutex_unlock(&handle_lock);
+            return 0;
+        }
+        hslots = t;
+        hslots_cap = cap;
+        if (hslots_used == 0) {
+            hslots_used = 1;
+        }
+    }
+
+    /*
+     * The front of the sweep's gap if it fits there, else the top. When
+     * the top would have to grow the sweep first gets HGROW times as much
+     * work as the heap would grow by, a sweep that lags far behind the
+     * mallocs lets the top run away from the gaps.
+     */
+    if ((size_t)(hscan - hdense) < asize && (size_t)(hend - htop) < asize) {
+        hcompact(HGROW * MAX(asize, HCHUNK));
+    }
+    if ((size_t)(hscan - hdense) >= asize) {
+        b = hdense;
+        hdense += asize;
+        hgap_close();
+    }
+    else {
+        if ((size_t)(hend - htop) < asize) {
+            grow = MAX(asize - (hend - htop), HCHUNK);
+            if (mem_hsbrk(grow) == (void *)-1) {
+                pthread_mutex_unlock(&handle_lock);
+                return 0;
+            }
+            hend += grow;
+        }
+        b = htop;
+        htop += asize;
+    }
+
+    if ((h = hslot_free) != 0) {
+        hslot_free = (size_t)hslots[h].bp;
+    }
+    else {
+        h = hslots_used++;
+    }
+    PUT(b, PACK(asize, ALLOC));
+    PUT(b + WSIZE, h);
+    hslots[h].bp = b + DSIZE;
+    hslots[h].locks = 0;
+    pthread_mutex_unlock(&handle_lock);
+    return h;
+}
+
+/*
+ * mm_hlock - Where the block of handle h is, it stays there until it is
+ *      unlocked as often as it was locked. NULL for handle 0.
+ */
+void *mm_hlock(mm_handle_t h)
+{
     char *bp;
+
+    if (h == 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&handle_lock);
+    hslots[h].locks++;
+    bp = hslots[h].bp;
+    pthread_mutex_unlock(&handle_lock);
+    return bp;
+}
+
+/*
+ * mm_hunlock - Undo one mm_hlock of handle h. Once it isn't locked
+ *      anymore the gaps a sweep had to leave are worth another look.
+ */
+void mm_hunlock(mm_handle_t h)
+{
+    if (h == 0) {
+        return;
+    }
+    pthread_mutex_lock(&handle_lock);
+    if (--hslots[h].locks == 0 && hskipped != NULL) {
+        hhole_note(hskipped);
+        hskipped = NULL;
+    }
+    pthread_mutex_unlock(&handle_lock);
+}
+
+/*
+ * mm_hfree - Free the block of handle h, and the handle with it.
+ *      A block at the top goes right away, any other one is a gap for
+ *      the compactor.
+ */
+void mm_hfree(mm_handle_t h)
+{
+    char *b;
     size_t size;
 
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-    if ((int)(bp = mem_sbrk(size)) == -1){ 
-    return NULL;
+    if (h == 0) {
+        return;
+    }
+    pthread_mutex_lock(&handle_lock);
+    b = hslots[h].bp - DSIZE;
+    size = GET_SIZE(b);
+    PUT(b, PACK(size, 0));
+    if (b + size == htop && b >= hscan) {
+        htop = b;
+    }
+    else if (b < hdense) {
+        hhole_note(b);
+    }
+    hslots[h].bp = (char *)hslot_free;
+    hslot_free = h;
+    hcompact(HSTEP);
+    pthread_mutex_unlock(&handle_lock);
+}
+
+/*
+ * mm_hcompact - Let the compactor move up to bytes bytes (0 for as much
+ *      as it takes). Returns 1 if there is more to do, 0 if the movable
+ *      heap has no gaps left but the ones in front of locked blocks.
+ */
+int mm_hcompact(size_t bytes)
+{
+    int more;
+
+    pthread_mutex_lock(&handle_lock);
+    more = hcompact(bytes > 0 ? bytes : (size_t)-1);
+    pthread_mutex_unlock(&handle_lock);
+    return more;
+}
+
+/*
+ * do_malloc - Allocate a block with at least size bytes of payload
+ *             
+ * We start by adjusting and aligning our size to include overhead and alignment
+ * requirements. Then we try to find a fit for our block, if we do we place our block 
+ * where it fits. 
+ * If no fit is found we extend the heap and then place our block.
+ */
+/* $begin mmalloc */
+static void *do_malloc(size_t size) 
+{
+    size_t asize;      /* Adjusted block size */
+    size_t extendsize; /* Amount to extend heap if no fit */
+    void *bp;
+
+    /* Ignore spurious requests. */
+    if (size == 0){
+        return NULL;
+	}
+    /* Tiny requests come from the slabs, huge ones from a mapping */
+    if (size < SLAB_MAX) {
+        return slab_alloc(size);
+    }
+    if (is_huge_size(size)) {
+        return huge_alloc(size);
+    }
+    /* Adjust block size to include overhead and alignment reqs. */
+    asize = adjust_and_align(size);
+
+    /* A deferred free of the same size is ready to go as it is */
+    if (asize <= QUICK_MAX && arena->quick[asize / DSIZE] != NULL) {
+        return quick_pop(asize);
+    }
+
+    /* Search the free list for a fit. */
+    if ((bp = find_or_flush(asize)) != NULL) {
+        place(bp, asize);
+		return bp;
+	}
+
+    /* No fit found.  Get more memory and place the block. */
+    extendsize = grow_size(asize);
+    if ((bp = extend_heap(extendsize / WSIZE)) == NULL){  
+		return NULL;
+	}
+    
+    place(bp, asize);
+	return bp;
+} 
+/* $end mmalloc */
+
+/*
+ * do_calloc - do_malloc with the payload cleared
+ *      Slab objects and deferred frees were used before and are cleared
+ *      whole. Any other block is placed like do_malloc does and only the
+ *      part of it below the arena's fresh mark is cleared, the rest was
+ *      never handed out, except for the footer of a free block that we
+ *      took up to the end of the segment.
+ */
+static void *do_calloc(size_t bytes)
+{
+    size_t asize;
+    char *bp, *fresh, *end, *ftr;
+
+    asize = adjust_and_align(bytes);
+    if (bytes < SLAB_MAX || (asize <= QUICK_MAX && arena->quick[asize / DSIZE] != NULL)) {
+        if ((bp = do_malloc(bytes)) != NULL) {
+            memset(bp, 0, bytes);
+            arena->counts.zeroed += bytes;
+        }
+        return bp;
+    }
+    if ((bp = find_or_flush(asize)) == NULL &&
+        (bp = extend_heap(grow_size(asize) / WSIZE)) == NULL) {
+        return NULL;
+    }
+    fresh = arena->fresh;
+    place(bp, asize);
+
+    end = bp + bytes;
+    if (end <= fresh) {
+        memset(bp, 0, bytes);
+        arena->counts.zeroed += bytes;
+        return bp;
+    }
+    if (fresh > bp) {
+        memset(bp, 0, fresh - bp);
+        arena->counts.zeroed += fresh - bp;
+    }
+    ftr = arena->brk - DSIZE;
+    if (end > ftr) {
+        memset(ftr, 0, end - ftr);
+    }
+    return bp;
+}
+
+/*
+ * do_malloc_batch - Allocate n blocks of size bytes each into out[]
+ *      Deferred frees of the right size go first, they are ready as they
+ *      are. The rest is carved out of a free block big enough for all of
+ *      them, or else out of whatever free block fits one or more of them,
+ *      or else out of a heap extension for all of them.
+ *      Returns how many blocks it got.
+ */
+static int do_malloc_batch(size_t size, int n, void **out)
+{
+    size_t asize, want;
+    int got = 0, k;
+    void *bp;
+
+    if (size < SLAB_MAX) {
+        while (got < n && (out[got] = slab_alloc(size)) != NULL) {
+            got++;
+        }
+        return got;
+    }
+    asize = adjust_and_align(size);
+    while (got < n && asize <= QUICK_MAX && arena->quick[asize / DSIZE] != NULL) {
+        out[got++] = quick_pop(asize);
+    }
+    while (got < n) {
+        k = n - got;
+        if ((size_t)k > MAX_HEAP / asize) {
+            k = MAX_HEAP / asize;
+        }
+        want = asize * k;
+        if ((bp = find_or_flush(want)) == NULL && (bp = find_or_flush(asize)) == NULL &&
+            (bp = extend_heap(grow_size(want) / WSIZE)) == NULL) {
+            break;
+        }
+        got += carve(bp, asize, k, out + got);
+    }
+    return got;
+}
+
+/*
+ * do_free - Free a block
+ * Same implementation as with implicit list.
+ * We get the size, put it into the header and 
+ * footer, tell the next block we are free now and
+ * coalesce where the block is inserted into the free list.
+ * Tiny objects have no header, they just go back to their slab.
+ */
+/* $begin mmfree */
+static void do_free(void *bp){
+    if (is_slab(bp)) {
+        slab_free(bp);
+        return;
+    }
+    if (GET(HDRP(bp)) & GROWN) {
+        grow_forget(bp);
+    }
+    if (deferred && GET_SIZE(HDRP(bp)) <= QUICK_MAX) {
+        quick_push(bp);
+        return;
+    }
+    free_block(bp);
+}
+
+/*
+ * do_free_sized - do_free for a block the caller asked size bytes for
+ *      A block asked for with at least SLAB_MAX bytes was never a slab
+ *      object (realloc moves those out), so we skip the page map. The
+ *      header is still loaded and compared: size can't be trusted for the
+ *      tags, a block with a tail too small to split off or with realloc
+ *      slack is bigger than size says, and PREV_ALLOC and GROWN are in
+ *      there too. What size buys is that free_block_size works out the
+ *      footer and the next block from it, the compare is only a branch
+ *      and they don't wait for the load. A block that is bigger, or
+ *      GROWN, takes the normal way.
+ */
+static void do_free_sized(void *bp, size_t size){
+    size_t asize;
+
+    if (size < SLAB_MAX) {
+        do_free(bp);
+        return;
+    }
+    asize = adjust_and_align(size);
+    if ((GET(HDRP(bp)) & ~(size_t)PREV_ALLOC) != PACK(asize, ALLOC)) {
+        do_free(bp);
+        return;
+    }
+    if (deferred && asize <= QUICK_MAX) {
+        quick_push(bp);
+        return;
+    }
+    free_block_size(bp, asize);
+}
+
+/*
+ * check_sized - the CHECK_SIZED check of mm_free_sized, abort unless bp
+ *      is allocated and holds at least size bytes. It can hold more, see
+ *      do_free_sized, so a size that is too small can't always be caught.
+ */
+static void check_sized(void *bp, size_t size){
+    size_t have;
+
+    if (!is_huge(bp) && !is_slab(bp) && !GET_ALLOC(HDRP(bp))) {
+        fprintf(stderr, "mm_free_sized: %p is not allocated\n", bp);
+        abort();
+    }
+    have = mm_usable_size(bp);
+    if (size == 0 || size > have) {
+        fprintf(stderr, "mm_free_sized: %p holds %zu bytes, not %zu\n", bp, have, size);
+        abort();
+    }
+}
+
+/* free_block - mark a block free and coalesce it right away, see free_block_size */
+static void free_block(void *bp){
+    free_block_size(bp, GET_SIZE(HDRP(bp)));
+}
+
+/*
+ * free_block_size - free_block for a block of size bytes
+ *      A big free block at the end of the heap is trimmed, one somewhere
+ *      else gives back the pages that were in use until now.
+ */
+static void free_block_size(void *bp, size_t size){
+    char *next = (char *)bp + size;
+    char *lo = bp;                      /* pages that may be dirty */
+    char *hi = next;
+
+    arena->freed += size;
+    /* free neighbours that released their pages say so in the footer */
+    if (!GET_PREV_ALLOC(HDRP(bp)) && !(GET((char *)bp - DSIZE) & RELEASED)) {
+        lo = PREV_BLKP(bp);
+    }
+    if (!GET_ALLOC(HDRP(next)) && !(GET(FTRP(next)) & RELEASED)) {
+        hi = NEXT_BLKP(next);
+    }
+
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(next - DSIZE, PACK(size, 0));   /* footer */
+    CLR_PREV_ALLOC(HDRP(next));
+    bp = coalesce(bp);
+
+    /* while the heap still grows every now and then we would just get the
+     * same pages back a moment later, unless a spike just went away */
+    if (arena->quiet < QUIET_FREES) {
+        arena->quiet++;
+        if (arena->freed < arena->heap / SPIKE_SHARE) {
+            release_pages(bp, lo, hi, 0);
+            return;
+        }
+    }
+    if (trim_heap(bp)) {
+        return;
+    }
+    release_pages(bp, lo, hi, GET_SIZE(HDRP(bp)) >= RELEASE_MIN);
+    /* the end of the heap may be free since before the gate opened */
+    if (!GET_PREV_ALLOC(HDRP(arena->brk))) {
+        trim_heap(PREV_BLKP(arena->brk));
+    }
+}
+
+/*
+ * free_run - free the k blocks in p, which lie right after each other in
+ *      the heap. They become one allocated block first so free_block only
+ *      has to coalesce (and maybe trim or release) once.
+ */
+static void free_run(void **p, int k){
+    size_t size = 0;
+    int i;
+
+    if (k == 1) {
+        do_free(p[0]);
+        return;
+    }
+    for (i = 0; i < k; i++) {
+        if (GET(HDRP(p[i])) & GROWN) {
+            grow_forget(p[i]);
+        }
+        size += GET_SIZE(HDRP(p[i]));
+    }
+    arena->counts.merges += k - 1;
+    PUT(HDRP(p[0]), PACK(size, GET_PREV_ALLOC(HDRP(p[0])) | ALLOC));
+    /* a quick list may take it as it is, the blocks it swallowed still count as touched */
+    if (touch_on) {
+        touch(p[0]);
+    }
+    free_block(p[0]);
+}
+
+/* ptr_cmp - qsort order of mm_free_batch, by address */
+static int ptr_cmp(const void *a, const void *b){
+    char *x = *(char * const *)a;
+    char *y = *(char * const *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * trim_heap - if the free block bp is the last block of the heap and at
+ *      least TRIM_MIN bytes, give all but TRIM_KEEP bytes of it back to
+ *      memlib. Returns 1 if it did.
+ */
+static int trim_heap(char *bp){
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t cut = size - TRIM_KEEP;
+
+    if (size < TRIM_MIN || NEXT_BLKP(bp) != arena->brk) {
+        return 0;
+    }
+    /* the block has to leave its list before its size changes */
+    removeBlock(bp);
+    pthread_mutex_lock(&sbrk_lock);
+    if (arena->brk != (char *)mem_heap_hi() + 1 || mem_sbrk(-(intptr_t)cut) == (void *)-1) {
+        pthread_mutex_unlock(&sbrk_lock);
+        insertBlock(bp);
+        return 0;
+    }
+    arena->brk -= cut;
+    pthread_mutex_unlock(&sbrk_lock);
+
+    PUT(HDRP(bp), PACK(TRIM_KEEP, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(TRIM_KEEP, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC));            /* new epilogue header */
+    insertBlock(bp);
+    arena->counts.trimmed += cut;
+    arena->heap -= cut;
+    return 1;
+}
+
+/*
+ * release_pages - give the whole pages between lo and hi back to the
+ *      system, as far as they are inside the free block bp, past the
+ *      RELEASE_KEEP bytes at its start and before its footer. The rest of
+ *      bp was given back before, it gets RELEASED. With now 0 nothing goes
+ *      back, bp only loses RELEASED if there were pages to give.
+ *      place takes the start of a free block, so a block that is split
+ *      and freed again and again only dirties what we keep.
+ */
+static void release_pages(char *bp, char *lo, char *hi, int now){
+    size_t page = mem_pagesize();
+
+    if (lo < bp + RELEASE_KEEP) {
+        lo = bp + RELEASE_KEEP;
+    }
+    if (hi > FTRP(bp)) {
+        hi = FTRP(bp);
+    }
+    lo = (char *)(((size_t)lo + page - 1) & ~(page - 1));
+    hi = (char *)((size_t)hi & ~(page - 1));
+    if (lo < hi) {
+        if (!now || madvise(lo, hi - lo, MADV_DONTNEED) != 0) {
+            PUT(FTRP(bp), GET(FTRP(bp)) & ~RELEASED);
+            return;
+        }
+        arena->counts.released += hi - lo;
+    }
+    if (now) {
+        PUT(FTRP(bp), GET(FTRP(bp)) | RELEASED);
+    }
+}
+
+/*
+ * do_realloc - Reallocates pointer ptr with size bytes.
+ * We start with adjusting the size to meet our requirements.
+ * We have some special cases to increase performance but if
+ * none of that works we just simply malloc a new block
+ * and free the old block. 
+ * A shrink always stays in place and gives the tail back.
+ * A block that keeps on growing gets slack, see grow_want.
+ */
+static void *do_realloc(void *ptr, size_t size){
+    void *newp;
+    size_t copySize, asize, nextSize, extendSize, want;
+    grow_t *g;
+    asize = adjust_and_align(size);
+
+    /* if ptr is NULL it is the same as calling mm_malloc(size) */
+    if(ptr == NULL) {
+        return do_malloc(size);
+    }
+
+    /* if size is 0 it is the same as calling mm_free(ptr) */
+    else if(size == 0) {
+        do_free(ptr);
+        return 0;
+    }
+
+    /* tiny objects can't grow, they stay put if the class is the same
+     * and are moved otherwise */
+    if(is_slab(ptr)) {
+        copySize = (slab_of(ptr)->cls + 1) * DSIZE;
+        if(size < SLAB_MAX && (size + DSIZE - 1) / DSIZE == copySize / DSIZE) {
+            return ptr;
+        }
+        /* out of memory, ptr is still good and the caller keeps it */
+        if((newp = do_malloc(size)) == NULL) {
+            return NULL;
+        }
+        memcpy(newp, ptr, size < copySize ? size : copySize);
+        arena->counts.moves++;
+        slab_free(ptr);
+        return newp;
+    }
+    
+    copySize = GET_SIZE(HDRP(ptr)); //size of the block pointed to by ptr */
+    g = (GET(HDRP(ptr)) & GROWN) ? grow_find(ptr) : NULL;
+
+    /* a block we gave slack to that still fits is growing into its slack,
+     * one that asks for less than last time shrinks and gives it back */
+    if (g != NULL && asize <= copySize) {
+        if (size >= g->req) {
+            g->grows++;
+            g->req = size;
+            return ptr;
+        }
+        grow_forget(ptr);
+        trim_block(ptr, asize);
+        return ptr;
+    }
+
+    /* if adjusted size is same as current ptr, just return ptr */
+    if (asize == copySize) {
+        return ptr;
+    }
+
+    /* shrinking never moves, a tail big enough to be a block goes back to
+     * the free lists. Slack a growing block should keep is GROWN and was
+     * taken care of above */
+    if (asize < copySize) {
+        trim_block(ptr, asize);
+        return ptr;
+    }
+
+    /* too big for the heap now, it moves to a mapping of its own and
+     * mremap takes care of it from then on */
+    if (is_huge_size(size)) {
+        if ((newp = huge_alloc(size)) == NULL) {
+            return NULL;
+        }
+        memcpy(newp, ptr, copySize - OVERHEAD);
+        arena->counts.moves++;
+        do_free(ptr);
+        return newp;
+    }
+
+    /* it grows, from now on we watch it (if there is room in the table)
+     * and once it did that often enough we want some slack on top */
+    if (g == NULL && size >= SLAB_MAX) {
+        g = grow_track(ptr);
+    }
+    want = grow_want(g, size, asize);
+
+    /* Special Cases -
+        next block is free and big enough
+        next block is free but not big enough but is at the end
+        our ptr block is the last block
+        previous block is free and big enough together with us
+    */
+    nextSize = GET_SIZE(HDRP(NEXT_BLKP(ptr))); //size of the next block
+    
+    /*Case 1 -  check if next block is free and big enough */
+    if(!GET_ALLOC(HDRP(NEXT_BLKP(ptr))) && nextSize + copySize >= asize) {
+        removeBlock(NEXT_BLKP(ptr));
+        PUT(HDRP(ptr), PACK(nextSize+copySize, (GET(HDRP(ptr)) & (PREV_ALLOC | GROWN)) | ALLOC));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+        used(ptr);
+        return ptr;
+    }
+    /*Case 2 - check if next block is free and the last block
+     *Case 3 - check if current block is at the end
+     * in both we grow the heap and take the free block after us. That only
+     * works at the end of the whole heap, some other arena may still grow it
+     * before we do, then the new memory ends up somewhere else and we move */
+    else if(at_heap_end(ptr)) {
+        extendSize = want > copySize + nextSize ? want - (copySize + nextSize) : 0;
+        extendSize = grow_size(extendSize);
+        if(extend_heap(extendSize/WSIZE) != NULL && !GET_ALLOC(HDRP(NEXT_BLKP(ptr))) &&
+           GET_SIZE(HDRP(NEXT_BLKP(ptr))) + copySize >= asize) {
+            removeBlock(NEXT_BLKP(ptr));
+            nextSize = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+            PUT(HDRP(ptr), PACK(nextSize+copySize, (GET(HDRP(ptr)) & (PREV_ALLOC | GROWN)) | ALLOC));
+            SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+            used(ptr);
+            return ptr;
+        }
+    }
+
+    /*Case 4 - the block before us is free and with us (and the next block
+     * if that is free too) it is big enough. We slide the payload down into
+     * it, that is still one copy but we don't leave a hole behind */
+    if(!GET_PREV_ALLOC(HDRP(ptr))) {
+        newp = grow_backward(ptr, want);
+        if(newp == NULL && want > asize) {
+            newp = grow_backward(ptr, asize);
+        }
+        if(newp != NULL) {
+            arena->counts.moves++;
+            if(g != NULL) {
+                grow_move(g, newp);
+            }
+            return newp;
+        }
+    }
+
+    /* if nothing above works, we just malloc a new block and return it,
+     * with the slack if we can get it */
+    newp = do_malloc(want - OVERHEAD);
+    if(newp == NULL && want > asize) {
+        newp = do_malloc(size);
+    }
+    /* out of memory, ptr is still good and the caller keeps it */
+    if(newp == NULL) {
+        return NULL;
+    }
+
+    /* only the payload is worth copying, there is no footer behind it */
+    copySize -= OVERHEAD;
+    if(size < copySize) {
+        copySize = size;
+    }
+
+    memcpy(newp, ptr, copySize);
+    arena->counts.moves++;
+    if(g != NULL) {
+        PUT(HDRP(ptr), GET(HDRP(ptr)) & ~(size_t)GROWN);
+        grow_move(g, newp);
+    }
+    do_free(ptr);
+    return newp;
+    
+}
+
+/*
+ * trim_block - Make the allocated block bp asize bytes and free the rest,
+ *      if the rest is at least a minimum block. The tail coalesces with
+ *      the block after it if that one is free.
+ */
+static void trim_block(void *bp, size_t asize){
+    size_t csize = GET_SIZE(HDRP(bp));
+    char *tail;
+
+    if (csize - asize < MIN_BLOCK) {
+        return;
+    }
+    arena->counts.splits++;
+    PUT(HDRP(bp), PACK(asize, (GET(HDRP(bp)) & (PREV_ALLOC | GROWN)) | ALLOC));
+    tail = NEXT_BLKP(bp);
+    PUT(HDRP(tail), PACK(csize - asize, PREV_ALLOC | ALLOC));
+    free_block(tail);
+}
+
+/*
+ * grow_backward - Grow the allocated block bp to asize bytes by merging it
+ *      with the free block before it, and the one after it if that is free
+ *      too. The payload is moved down to the start of the merged block.
+ *      Returns the new payload, or NULL (and changes nothing) if the merged
+ *      block would still be too small.
+ */
+static void *grow_backward(void *bp, size_t asize){
+    char *prev = PREV_BLKP(bp);
+    char *next = NEXT_BLKP(bp);
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t total = size + GET_SIZE(HDRP(prev));
+
+    if (!GET_ALLOC(HDRP(next))) {
+        total += GET_SIZE(HDRP(next));
+    }
+    if (total < asize) {
+        return NULL;
+    }
+    arena->counts.merges++;
+    removeBlock(prev);
+    if (!GET_ALLOC(HDRP(next))) {
+        arena->counts.merges++;
+        removeBlock(next);
+    }
+    /* the merged block follows an allocated one like every free block does */
+    PUT(HDRP(prev), PACK(total, PREV_ALLOC | ALLOC));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(prev)));
+    used(prev);
+    memmove(prev, bp, size - OVERHEAD);
+    trim_block(prev, asize);
+    return prev;
+}
+
+/*
+ * grow_find - the grow table entry of block bp (its g bit is set)
+ */
+static grow_t *grow_find(char *bp){
+    int i;
+
+    for (i = 0; i < GROW_SLOTS; i++) {
+        if (arena->grows[i].bp == bp) {
+            return &arena->grows[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * grow_track - start watching block bp grow, in a free slot or instead of
+ *      a block that only grew once so far. Returns NULL if every slot has
+ *      a block that keeps on growing.
+ */
+static grow_t *grow_track(char *bp){
+    grow_t *g = NULL;
+    int i;
+
+    for (i = 0; i < GROW_SLOTS; i++) {
+        if (arena->grows[i].bp == NULL) {
+            g = &arena->grows[i];
+            break;
+        }
+        if (g == NULL && arena->grows[i].grows < GROW_DETECT) {
+            g = &arena->grows[i];
+        }
+    }
+    if (g == NULL) {
+        return NULL;
+    }
+    if (g->bp != NULL) {
+        PUT(HDRP(g->bp), GET(HDRP(g->bp)) & ~(size_t)GROWN);
+    }
+    g->bp = bp;
+    g->grows = 0;
+    g->req = 0;
+    PUT(HDRP(bp), GET(HDRP(bp)) | GROWN);
+    return g;
+}
+
+/* grow_forget - stop watching block bp, it is freed or shrinks */
+static void grow_forget(char *bp){
+    grow_t *g = grow_find(bp);
+
+    if (g != NULL) {
+        g->bp = NULL;
+    }
+    PUT(HDRP(bp), GET(HDRP(bp)) & ~(size_t)GROWN);
+}
+
+/* grow_move - the block of g moved to bp */
+static void grow_move(grow_t *g, char *bp){
+    g->bp = bp;
+    PUT(HDRP(bp), GET(HDRP(bp)) | GROWN);
+}
+
+/*
+ * grow_want - count a grow of the block of g (NULL if we don't watch it)
+ *      to size bytes, asize adjusted, and return the block size to give it.
+ *      That is asize, plus size >> GROW_SLACK_SHIFT from the GROW_DETECT'th
+ *      grow on.
+ */
+static size_t grow_want(grow_t *g, size_t size, size_t asize){
+    size_t slack;
+
+    if (g == NULL) {
+        return asize;
+    }
+    g->req = size;
+    if (++g->grows < GROW_DETECT) {
+        return asize;
+    }
+    slack = size >> GROW_SLACK_SHIFT;
+    if (slack > GROW_SLACK_MAX) {
+        slack = GROW_SLACK_MAX;
+    }
+    /* the slack must not push it out of the heap, the table only has heap blocks */
+    if (is_huge_size(size + slack)) {
+        return asize;
+    }
+    return adjust_and_align(size + slack);
+}
+
+/*
+ * Checks the heap for consistency. Returns a nonzero value if and only if
+ * the heap is consistent.
+ * Checks if
+ *     The prologue/epilogue headers are right
+ *     The headers match the footers
+ *     Every block in the free list is marked as free
+ *     Adjacent free blocks should have been coalesced
+ *     Every free block is actually in the free list
+ *     Every free block is in the list of its own size class
+ *     The grow table and the grown bits agree
+ *     The movable blocks and the handle table agree
+ * The time it takes is linear in the number of blocks: the free lists are
+ * walked once to mark their blocks (mark_lists) and the heap walk only has
+ * to look at the mark of every free block it finds. The marks are kept in
+ * list_map, mm_check never writes to the heap.
+ */
+int mm_check(void) {
+    int i;
+    int is_good = 1;
+
+    lock_arenas();
+    for (i = 0; i < num_arenas; i++) {
+        arena = &arenas[i];
+        if (!check_heap()) {
+            printf("Arena %d is bad\n", i);
+            is_good = 0;
+        }
+    }
+    unlock_arenas();
+    pthread_mutex_lock(&handle_lock);
+    if (!check_handles()) {
+        printf("Movable heap is bad\n");
+        is_good = 0;
+    }
+    pthread_mutex_unlock(&handle_lock);
+    return is_good;
+}
+
+/*
+ * mm_check_touched - mm_check for the blocks that went on or off a free
+ *      list since the last call, and their neighbours (see check_touched).
+ *      That is cheap enough to run after every malloc and free. The first
+ *      call, and any call after an arena touched more than TOUCH_LOG blocks,
+ *      checks the whole arena like mm_check. The movable heap is left to
+ *      mm_check.
+ */
+int mm_check_touched(void) {
+    int i;
+    int is_good = 1;
+
+    lock_arenas();
+    touch_on = 1;
+    for (i = 0; i < num_arenas; i++) {
+        arena = &arenas[i];
+        if (!check_touched()) {
+            printf("Arena %d is bad\n", i);
+            is_good = 0;
+        }
+    }
+    unlock_arenas();
+    return is_good;
+}
+
+/*
+ * check_handles - walks the movable heap, every block has a sane size,
+ *      the sweep's gap is one free block and every used block is where
+ *      its handle says. handle_lock is held.
+ */
+static int check_handles(void) {
+    char *b = mem_hheap_lo();
+    size_t h;
+    int is_good = 1;
+
+    if (!(b <= hdense && hdense <= hscan && hscan <= htop && htop <= hend) ||
+        hend != b + mem_hheapsize()) {
+        printf("Movable heap pointers are out of order\n");
+        return 0;
+    }
+    if (hdense < hscan && (GET_SIZE(hdense) != (size_t)(hscan - hdense) || GET_ALLOC(hdense))) {
+        printf("Gap %p of the sweep is not a free block up to %p\n", hdense, hscan);
+        is_good = 0;
+    }
+    while (b < htop) {
+        if (GET_SIZE(b) == 0 || GET_SIZE(b) % DSIZE != 0 || b + GET_SIZE(b) > htop) {
+            printf("Movable block %p has a bad size\n", b);
+            return 0;
+        }
+        if (GET_ALLOC(b)) {
+            h = GET(b + WSIZE);
+            if (h == 0 || h >= hslots_used || hslots[h].bp != b + DSIZE) {
+                printf("Movable block %p and its handle %zu disagree\n", b, h);
+                is_good = 0;
+            }
+        }
+        b += GET_SIZE(b);
+    }
+    return is_good;
+}
+
+/*
+ * check_segment - checks the blocks of one heap segment of the current
+ *      arena, heap_listp is its prologue. The free lists are marked (see
+ *      mark_lists). Returns 0 if something is wrong.
+ *      On the way block_map learns the first block on every page.
+ */
+static int check_segment(char *heap_listp) {
+    char *bp;
+    size_t page, last = (size_t)-1;
+    int is_good = 1;
+    /*
+     *Checks the prologue header. If it is not of size DSIZE or is not allocated
+     *it is not right
+    */
+    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp))) {
+        printf("Bad prologue header\n");
+        is_good = 0;
+    }
+
+    /*
+     *runs through every block on the heap and checks if (check_block)
+     *   we are doubleword aligning
+     *   a free block is in our free list
+     *   there are adjacent free blocks that need to be coalesced
+     *   the header of a free block matches its footer
+     *   the prev allocated bit of the next block is right
+     *   
+    */
+
+    for(bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp)) {
+        if(!check_block(bp, 1)) {
+            is_good = 0;
+        }
+        /* pages with no block starting on them don't have one in the map */
+        for(page = heap_page(bp); page <= heap_page(NEXT_BLKP(bp) - 1); page++) {
+            if(page != last) {
+                block_map[page] = 0;
+            }
+        }
+        if(heap_page(bp) != last) {
+            block_note(bp);
+            last = heap_page(bp);
+        }
+    }
+
+    /*
+     *Checks the epilogue header. If it is not of size 0 and not allocated
+     *it is not right
+     */
+     if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp)))) {
+         printf("Bad epilogue header\n");
+         is_good = 0;
+     }
+
+     return is_good;
+}
+
+/*
+ * check_block - the checks of one block bp of the current arena, and of
+ *      how it fits with the block after it. With marked set the free lists
+ *      are marked, otherwise a free block is looked up in its list.
+ */
+static int check_block(char *bp, int marked) {
+    int is_good = checkblock(bp);
+
+    if(arena_of(bp) != arena) {
+        printf("Block %p is not on a page of its arena\n", bp);
+        is_good = 0;
+    }
+    if(!GET_ALLOC(HDRP(bp))) {
+        if(marked ? !list_marked(bp) : !listed(bp)) {
+            printf("Block %p is not in the free list of its class\n", bp);
+            is_good = 0;
+        }
+        if(!GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+            printf("Block %p and the block after it should have been coalesced\n", bp);
+            is_good = 0;
+        }
+    }
+    if((GET(HDRP(bp)) & GROWN) && (!GET_ALLOC(HDRP(bp)) || grow_find(bp) == NULL)) {
+        printf("Block %p has the grown bit but is not in the grow table\n", bp);
+        is_good = 0;
+    }
+    if(!GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))) != !GET_ALLOC(HDRP(bp))) {
+        printf("Block %p after %p has the wrong prev allocated bit\n", NEXT_BLKP(bp), bp);
+        is_good = 0;
+    }
+    return is_good;
+}
+
+/*
+ * check_heap - does the work of mm_check for the current arena, its lock is held
+ */
+static int check_heap(void) {
+    char *seg;
+    char *bp;
+    int i;
+    int is_good = 1;
+
+    /* every free block the walk finds has to carry the mark of its list */
+    if (!mark_lists(1)) {
+        is_good = 0;
+    }
+    for (seg = arena->segs; seg != NULL; seg = *(char **)seg) {
+        if (!check_segment(seg + DSIZE)) {
+            is_good = 0;
+        }
+    }
+    mark_lists(0);
+    arena->ntouched = 0;
+
+#if USE_TLSF
+     /* the bitmaps must say exactly which lists are non empty */
+     for(i = 0; i < NUM_CLASSES; i++) {
+         if(((arena->sl_bitmap[i / SL_COUNT] >> (i % SL_COUNT)) & 1) != (arena->seg_lists[i] != NULL) ||
+            ((arena->fl_bitmap >> (i / SL_COUNT)) & 1) != (arena->sl_bitmap[i / SL_COUNT] != 0)) {
+             printf("Bitmaps are wrong for list %d\n", i);
+             is_good = 0;
+         }
+     }
+#endif
+     /* blocks on the quick lists look allocated and have the size of their list */
+     for(i = 0; i < QUICK_BINS; i++) {
+         int len = 0;
+
+         for(bp = arena->quick[i]; bp != NULL; bp = *(char **)bp) {
+             if(!GET_ALLOC(HDRP(bp)) || GET_SIZE(HDRP(bp)) != (size_t)i * DSIZE) {
+                 printf("Block %p on quick list %d is free or has the wrong size\n", bp, i);
+                 is_good = 0;
+             }
+             len++;
+         }
+         if(len != arena->quick_len[i]) {
+             printf("Quick list %d has %d blocks, not %d\n", i, len, arena->quick_len[i]);
+             is_good = 0;
+         }
+     }
+     /* every block in the grow table is allocated and knows it is there */
+     for(i = 0; i < GROW_SLOTS; i++) {
+         bp = arena->grows[i].bp;
+         if(bp != NULL && (!GET_ALLOC(HDRP(bp)) || !(GET(HDRP(bp)) & GROWN))) {
+             printf("Block %p in the grow table is free or has no grown bit\n", bp);
+             is_good = 0;
+         }
+     }
+#if !USE_TLSF
+     /* the tree has to be ordered and only hold free blocks that belong in it */
+     if(!tree_check(arena->tree_root, TREE_MIN, (size_t)-1)) {
+         is_good = 0;
+     }
+#endif
+
+     return is_good;
+
+}
+
+/*
+ * mark_lists - With on set, checks that every block on the free lists of
+ *      the current arena is free and in the list of its size class, and
+ *      marks it in list_map. A block that is marked already is on the
+ *      lists twice (or a list runs in a circle), that ends the list.
+ *      With on clear it takes the marks off again, walking the lists the
+ *      same way. Returns 0 if something is wrong.
+ */
+static int mark_lists(int on) {
+    char *bp;
+    int i;
+    int is_good = 1;
+
+    for(i = 0; i < NUM_CLASSES; i++) {
+        for(bp = arena->seg_lists[i]; bp != NULL; bp = NEXT_FREE(bp)) {
+            if(!on) {
+                /* the walk with on set stopped at the first block without a mark */
+                if(list_marked(bp) != 1 || GET_ALLOC(HDRP(bp))) {
+                    break;
+                }
+                list_mark(bp, 0);
+                continue;
+            }
+            if(list_marked(bp) < 0) {
+                printf("Block %p in free list is not in the heap\n", bp);
+                is_good = 0;
+                break;
+            }
+            if(GET_ALLOC(HDRP(bp))) {
+                printf("Block %p in free list is actually not free\n", bp);
+                is_good = 0;
+                break;
+            }
+            if(list_marked(bp)) {
+                printf("Block %p is on the free lists twice\n", bp);
+                is_good = 0;
+                break;
+            }
+            if(size_class(GET_SIZE(HDRP(bp))) != i) {
+                printf("Block %p of size %zu is in class %d\n", bp, GET_SIZE(HDRP(bp)), i);
+                is_good = 0;
+            }
+            list_mark(bp, 1);
+        }
+    }
+#if !USE_TLSF
+    if(!tree_mark(arena->tree_root, on)) {
+        is_good = 0;
+    }
+#endif
+    return is_good;
+}
+
+/*
+ * list_marked - the mark of bp in list_map, -1 if bp is not a block
+ *      address in the heap (list_map has no room for it)
+ */
+static inline int list_marked(char *bp) {
+    size_t i = (size_t)(bp - (char *)mem_heap_lo()) / DSIZE;
+
+    if(bp < (char *)mem_heap_lo() || bp > (char *)mem_heap_hi() || (size_t)bp % DSIZE != 0) {
+        return -1;
+    }
+    return (list_map[i / 8] >> (i % 8)) & 1;
+}
+
+/* list_mark - set (on) or clear the mark of bp in list_map */
+static inline void list_mark(char *bp, int on) {
+    size_t i = (size_t)(bp - (char *)mem_heap_lo()) / DSIZE;
+
+    if(list_marked(bp) < 0) {
+        return;
+    }
+    if(on) {
+        list_map[i / 8] |= 1 << (i % 8);
+    }
+    else {
+        list_map[i / 8] &= ~(1 << (i % 8));
+    }
+}
+
+/*
+ * listed - is the free block bp in the free list (or tree) it belongs in,
+ *      from its links alone: its neighbours in the list have to point back
+ *      at it or it has to be the head.
+ */
+static int listed(char *bp) {
+    char *prev = PREV_FREE(bp);
+    char *next = NEXT_FREE(bp);
+    int i;
+
+#if !USE_TLSF
+    if(GET_SIZE(HDRP(bp)) > TREE_MIN) {
+        prev = CHAIN_PREV(bp);
+        return prev != NULL ? CHAIN_NEXT(prev) == bp : tree_contains(bp);
+    }
+#endif
+    i = size_class(GET_SIZE(HDRP(bp)));
+#if USE_TLSF
+    if(!((arena->sl_bitmap[i / SL_COUNT] >> (i % SL_COUNT)) & 1)) {
+        return 0;
+    }
+#endif
+    return (prev != NULL ? NEXT_FREE(prev) == bp : arena->seg_lists[i] == bp) &&
+           (next == NULL || PREV_FREE(next) == bp);
+}
+
+/*
+ * check_touched - does the work of mm_check_touched for the current arena,
+ *      its lock is held.
+ *      insertBlock and removeBlock log every block they get (touch), that
+ *      is every block that was made, split, merged, handed out or freed.
+ *      What's left to find is where the blocks are now, a logged block
+ *      may be in the middle of a bigger one since. block_map remembers a
+ *      block on every heap page, the walk to a logged block starts at the
+ *      nearest one in front of it. It checks every block on the way, the
+ *      one the logged block is in and the one after that. A block start in
+ *      the map can only go away when a block in front of it grows over it,
+ *      touch takes it out of the map then.
+ *      Logs that overflowed get the whole arena checked instead.
+ */
+static int check_touched(void) {
+    char *seg, *bp, *e, *near;
+    char *end = NULL;
+    size_t page, first;
+    int i;
+    int is_good = 1;
+
+    if (arena->ntouched > TOUCH_LOG) {
+        return check_heap();
+    }
+    qsort(arena->touched, arena->ntouched, sizeof(char *), ptr_cmp);
+    for (i = 0; i < arena->ntouched; i++) {
+        e = arena->touched[i];
+        if (e < end) {
+            continue;
+        }
+        /* segments are newer the higher they are, e is in the first one below it */
+        for (seg = arena->segs; seg != NULL && seg >= e; seg = *(char **)seg)
+            ;
+        if (seg == NULL) {
+            printf("Block %p is not in a segment of its arena\n", e);
+            is_good = 0;
+            continue;
+        }
+        if (seg == arena->segs && e >= arena->brk) {
+            /* trimmed off, the map may still have blocks from there too */
+            continue;
+        }
+        bp = seg + DSIZE;
+        first = heap_page(bp);
+        for (page = heap_page(e) + 1; page-- > first; ) {
+            near = block_on(page);
+            if (near != NULL && near >= bp && near < e) {
+                bp = near;
+                break;
+            }
+        }
+        while (GET_SIZE(HDRP(bp)) > 0 && NEXT_BLKP(bp) <= e) {
+            if (GET_SIZE(HDRP(bp)) % DSIZE != 0) {
+                printf("Block %p has a bad size\n", bp);
+                return 0;
+            }
+            if (!check_block(bp, 0)) {
+                is_good = 0;
+            }
+            block_note(bp);
+            bp = NEXT_BLKP(bp);
+        }
+        if (GET_SIZE(HDRP(bp)) == 0) {
+            /* e was trimmed off the end of an older segment */
+            if (!GET_ALLOC(HDRP(bp)) || seg == arena->segs) {
+                printf("Bad epilogue header\n");
+                is_good = 0;
+            }
+            continue;
+        }
+        if (!check_block(bp, 0) ||
+            (GET_SIZE(HDRP(NEXT_BLKP(bp))) > 0 && !check_block(NEXT_BLKP(bp), 0))) {
+            is_good = 0;
+        }
+        /* block starts in the map that bp grew over */
+        for (page = heap_page(bp); page <= heap_page(NEXT_BLKP(bp) - 1); page++) {
+            near = block_on(page);
+            if (near > bp && near < NEXT_BLKP(bp)) {
+                block_map[page] = 0;
+            }
+        }
+        block_note(bp);
+        end = NEXT_BLKP(bp);
+    }
+    arena->ntouched = 0;
+    return is_good;
+}
+
+/*
+ * touch - insertBlock or removeBlock got bp, mm_check_touched will look at
+ *      it. bp may have just grown over blocks block_map has, or be about to
+ *      be swallowed itself, and be cut up again before anyone looks, so bp
+ *      and what is in it go from the map right away.
+ */
+static inline void touch(char *bp) {
+    size_t page;
+    char *near;
+
+    for (page = heap_page(bp); page <= heap_page(NEXT_BLKP(bp) - 1); page++) {
+        near = block_on(page);
+        if (near >= bp && near < NEXT_BLKP(bp)) {
+            block_map[page] = 0;
+        }
+    }
+    if (arena->ntouched < TOUCH_LOG) {
+        arena->touched[arena->ntouched++] = bp;
+    }
+    else {
+        arena->ntouched = TOUCH_LOG + 1;
+    }
+}
+
+/* block_note - bp is a block, block_map keeps the lowest one of each page */
+static inline void block_note(char *bp) {
+    char *near = block_on(heap_page(bp));
+
+    if (near == NULL || near > bp) {
+        block_map[heap_page(bp)] = ((size_t)bp & (SLAB_SIZE - 1)) / WSIZE + 1;
+    }
+}
+
+/* block_on - the block block_map has for a heap page, NULL if none */
+static inline char *block_on(size_t page) {
+    if (block_map[page] == 0) {
+        return NULL;
+    }
+    return (char *)((((size_t)mem_heap_lo() >> SLAB_SHIFT) + page) << SLAB_SHIFT) +
+           (block_map[page] - 1) * WSIZE;
+}
+
+
+/* The remaining routines are internal helper routines */
+
+/*
+ * extend_heap - Extend the heap of the current arena with a free block
+ *      and return its pointer
+ *      If the arena's last segment is still the end of the heap the block
+ *      goes where its epilogue was, otherwise we start a new segment for it.
+ */
+/* $begin mmextendheap */
+static void *extend_heap(size_t words) {
+    char *bp, *merged, *clean;
+    size_t size;
+    int seg = 0;
+
+    /* Allocate an even number of words to maintain alignment */
+    size = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
+
+    pthread_mutex_lock(&sbrk_lock);
+    clean = mem_heap_clean();
+    if (arena->brk != (char *)mem_heap_hi() + 1) {
+        seg = 1;
+        if (new_segment() == NULL) {
+            pthread_mutex_unlock(&sbrk_lock);
+            return NULL;
+        }
+        /* arenas that take turns growing would chop the heap into lots of
+         * small segments that can't coalesce, so take a bigger piece */
+        if (num_arenas > 1 && size < SEG_MIN) {
+            size = SEG_MIN;
+        }
+    }
+    if ((bp = mem_sbrk(size)) == (void *)-1){ 
+        pthread_mutex_unlock(&sbrk_lock);
+        return NULL;
+    }
+    arena->brk = bp + size;
+    map_pages(bp, arena->brk);
+    pthread_mutex_unlock(&sbrk_lock);
+    arena->quiet = 0;
+    arena->placed = 0;
+    arena->freed = 0;
+    arena->heap += size;
+    arena->counts.extends++;
+
+    /* Initialize free block header/footer and the epilogue header
+     * the new block takes over the prev allocated bit of the old epilogue */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /* free block header */
+    PUT(FTRP(bp), PACK(size, 0));                        /* free block footer */
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, ALLOC));            /* new epilogue header */
+
+    merged = coalesce(bp);
+    fresh_grow(bp, merged, clean, seg);
+    return merged;
+}
+/* $end mmextendheap */
+
+/*
+ * fresh_grow - Move the fresh mark of the arena after extend_heap got the
+ *      block bp (merged is what it coalesced into). clean is where memlib's
+ *      untouched memory started before, seg is set if bp is in a new segment.
+ *      If the old end of the segment was still fresh and so is bp, the mark
+ *      stays where it is, but the old footer and the header of bp are in the
+ *      middle of the merged block now and have to be cleared.
+ */
+static void fresh_grow(char *bp, char *merged, char *clean, int seg){
+    if (!seg && merged != bp && clean <= bp && arena->fresh <= bp - DSIZE) {
+        PUT(bp - DSIZE, 0);
+        PUT(bp - WSIZE, 0);
+        return;
+    }
+    arena->fresh = clean > bp + 4*WSIZE ? clean : bp + 4*WSIZE;
+}
+
+/*
+ * used - bp was just handed out, everything up to its end is not fresh
+ *      anymore and neither are the links of the free block after it
+ */
+static inline void used(char *bp){
+    char *end = NEXT_BLKP(bp) + 4*WSIZE;
+
+    if (end > arena->fresh) {
+        arena->fresh = end;
+    }
+}
+
+/*
+ * grow_size - How much to extend the heap by for a request of asize bytes
+ *      The arena is ramping up (and will be back soon) if since it last
+ *      grew it handed out at least half a step and grow_ramp times the
+ *      bytes it got back. Then the step doubles and is at least GROW_REQS
+ *      of the recent requests, so a ramp of big blocks doesn't need an
+ *      extension for every block. Otherwise it halves. It stays between
+ *      grow_min and grow_max and never gets bigger than a GROW_SHARE'th of
+ *      the arena's heap, whatever is left of the last step at the peak is
+ *      lost to util.
+ */
+static size_t grow_size(size_t asize){
+    size_t step = arena->step;
+
+    if (arena->placed >= step / 2 && arena->placed >= grow_ramp * arena->freed) {
+        step = step <= grow_max / 2 ? 2 * step : grow_max;
+        if (step < GROW_REQS * arena->req) {
+            step = GROW_REQS * arena->req;
+        }
+    }
+    else {
+        step /= 2;
+    }
+    if (step > grow_max) {
+        step = grow_max;
+    }
+    if (step > arena->heap / GROW_SHARE) {
+        step = arena->heap / GROW_SHARE;
+    }
+    if (step < grow_min) {
+        step = grow_min;
+    }
+    arena->step = step;
+    return MAX(asize, step);
+}
+
+/*
+ * new_segment - Start a new segment for the current arena at the end of
+ *      the heap, with a link to its last one, a prologue and an epilogue.
+ *      Returns the segment, or NULL if we are out of memory.
+ *      With more than one arena the segment starts on a page of its own.
+ *      sbrk_lock is held.
+ */
+static char *new_segment(void) {
+    char *seg;
+    size_t pad = 0;
+
+    if (num_arenas > 1) {
+        pad = -(size_t)((char *)mem_heap_hi() + 1) & (SLAB_SIZE - 1);
+    }
+    if ((seg = mem_sbrk(pad + 4*WSIZE)) == (void *)-1) {
+        return NULL;
+    }
+    seg += pad;
+
+    *(char **)seg = arena->segs;                               /* Link to the last segment */
+    PUT(seg +  WSIZE,  PACK(DSIZE, PREV_ALLOC | ALLOC));       /* Prologue header */ 
+    PUT(seg + DSIZE, PACK(DSIZE, PREV_ALLOC | ALLOC));         /* Prologue footer */ 
+    PUT(seg + DSIZE+WSIZE, PACK(0, PREV_ALLOC | ALLOC));       /* Epilogue header */
+    arena->segs = seg;
+    arena->brk = seg + 4*WSIZE;
+    map_pages(seg, arena->brk);
+    return seg;
+}
+
+/*
+ * map_pages - The current arena owns the heap pages from lo up to hi
+ *      Whatever block_map knew about them is from before a trim.
+ *      sbrk_lock is held.
+ */
+static void map_pages(char *lo, char *hi) {
+    size_t page = heap_page(lo);
+    size_t last = heap_page(hi - 1);
+
+    for (; page <= last; page++) {
+        arena_map[page] = arena - arenas;
+        block_map[page] = 0;
+    }
+    if (last > page_map_hi) {
+        __atomic_store_n(&page_map_hi, last, __ATOMIC_RELAXED);
+    }
+}
+
+
+/*
+ * find_fit - Find a fit for a block with asize bytes
+ * 
+ * We use a first fit search that starts in the list of the size class of asize.
+ * Blocks in that class can still be too small so we have to check them, but
+ * every block in a bigger class fits so there we just take the first one.
+ * Large requests, and small ones when the lists are empty, get the best fit
+ * out of the tree.
+ * If no such fit is found we return NULL
+ */
+#if USE_TLSF
+/*
+ * find_fit - TLSF version
+ *
+ * asize is rounded up to the start of the next second level range so that
+ * every block in the list we land on is big enough. Then the bitmaps give us
+ * the first non empty list at or above that one, first in the same first
+ * level and otherwise in the next non empty first level.
+ */
+static void *find_fit(size_t asize){
+    int fl, sl;
+    unsigned int sl_map;
+    unsigned long fl_map;
+
+    if (asize >= (1 << FL_SHIFT)) {
+        asize += ((size_t)1 << (fls_size(asize) - SL_LOG2)) - 1;
+    }
+    tlsf_mapping(asize, &fl, &sl);
+    if (fl >= FL_COUNT) {
+        return NULL;
+    }
+
+    sl_map = arena->sl_bitmap[fl] & (~0U << sl);
+    if (!sl_map) {
+        fl_map = (fl + 1 < FL_COUNT) ? arena->fl_bitmap & (~0UL << (fl + 1)) : 0;
+        if (!fl_map) {
+            return NULL;
+        }
+        fl = __builtin_ctzl(fl_map);
+        sl_map = arena->sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+    return arena->seg_lists[fl * SL_COUNT + sl];
+}
+#else
+static void *find_fit(size_t asize){
+    void *bp;
+    int i;
+
+    if (asize <= TREE_MIN) {
+        i = size_class(asize);
+        for (bp = arena->seg_lists[i]; bp != NULL; bp = NEXT_FREE(bp) ){
+            if (asize <= (size_t)GET_SIZE(HDRP(bp)) ) {
+                return bp;
+            }
+        }
+        for (i++; i < NUM_CLASSES; i++) {
+            if (arena->seg_lists[i] != NULL) {
+                return arena->seg_lists[i];
+            }
+        }
+    }
+
+    return tree_best_fit(asize);
+}
+#endif
+
+/*Find_best_fit - best fit algorithm for finding a free block
+ *          here we traverse the free lists and find the free block
+ *          with the closest size to aSize
+ *
+ * Every block in a class is bigger than every block in the classes before
+ * it, so the first class that has a block that fits also has the best one.
+ * Above the lists it is the tree, which gives us the best fit directly.
+ *
+ * This algorithm did worse in throughput than the first fit one
+ * so it is only used with the MM_BEST_FIT policy
+ */
+static void *find_best_fit(size_t asize) {
+    void *bp;
+    void *best = NULL;
+    int i;
+    
+#if !USE_TLSF
+    if(asize > TREE_MIN) {
+        return tree_best_fit(asize);
+    }
+#endif
+    for(i = size_class(asize); i < NUM_CLASSES && best == NULL; i++) {
+        for(bp = arena->seg_lists[i]; bp != NULL; bp = NEXT_FREE(bp)) {
+            size_t currSize = GET_SIZE(HDRP(bp));
+            if(asize == currSize) {
+                return bp;
+            }
+            else if(asize < currSize) {
+                if(best == NULL || currSize < GET_SIZE(HDRP(best))) {
+                    best = bp;
+                }
+            }
+        }
+    }
+#if !USE_TLSF
+    if(best == NULL) {
+        best = tree_best_fit(asize);
+    }
+#endif
+    
+    return best;
+
+}
+
+#if !USE_TLSF
+/*
+ * find_next_fit - next fit algorithm for finding a free block
+ *          the search in the class of asize starts at the rover of
+ *          that class and wraps around to the front of the list.
+ *          The rover is left at the block we found, removeBlock moves
+ *          it along when that block leaves the list.
+ *          Bigger classes and the tree are done like in find_fit.
+ */
+static void *find_next_fit(size_t asize) {
+    char *bp;
+    char *start;
+    int i;
+
+    if(asize > TREE_MIN) {
+        return tree_best_fit(asize);
+    }
+    i = size_class(asize);
+    start = arena->rovers[i] != NULL ? arena->rovers[i] : arena->seg_lists[i];
+    for(bp = start; bp != NULL; bp = NEXT_FREE(bp)) {
+        if(asize <= GET_SIZE(HDRP(bp))) {
+            return arena->rovers[i] = bp;
+        }
+    }
+    for(bp = arena->seg_lists[i]; bp != start; bp = NEXT_FREE(bp)) {
+        if(asize <= GET_SIZE(HDRP(bp))) {
+            return arena->rovers[i] = bp;
+        }
+    }
+    for(i++; i < NUM_CLASSES; i++) {
+        if(arena->seg_lists[i] != NULL) {
+            return arena->seg_lists[i];
+        }
+    }
+    return tree_best_fit(asize);
+}
+
+/*
+ * find_good_fit - bounded best fit
+ *          like find_best_fit, but we take the first block that wastes at most
+ *          good_slack bytes and after good_probes blocks we settle for the best
+ *          one we have seen so far.
+ */
+static void *find_good_fit(size_t asize) {
+    char *bp;
+    char *best = NULL;
+    int probes = 0;
+    int i;
+
+    if(asize > TREE_MIN) {
+        return tree_best_fit(asize);
+    }
+    for(i = size_class(asize); i < NUM_CLASSES && best == NULL; i++) {
+        for(bp = arena->seg_lists[i]; bp != NULL; bp = NEXT_FREE(bp)) {
+            size_t currSize = GET_SIZE(HDRP(bp));
+            if(asize <= currSize) {
+                if(currSize - asize <= good_slack) {
+                    return bp;
+                }
+                if(best == NULL || currSize < GET_SIZE(HDRP(best))) {
+                    best = bp;
+                }
+            }
+            if(++probes >= good_probes && best != NULL) {
+                return best;
+            }
+        }
+    }
+    if(best == NULL) {
+        best = tree_best_fit(asize);
+    }
+    return best;
+}
+#endif
+
+/*
+ * find_block - find a free block of at least asize bytes with the current
+ *          placement policy, NULL if there is none
+ */
+static void *find_block(size_t asize) {
+#if !USE_TLSF
+    switch(fit_policy) {
+    case MM_NEXT_FIT:
+        return find_next_fit(asize);
+    case MM_BEST_FIT:
+        return find_best_fit(asize);
+    case MM_GOOD_FIT:
+        return find_good_fit(asize);
+    }
+#endif
+    return find_fit(asize);
+}
+
+/*
+ * mm_set_policy - change the placement policy to one of the MM_xxx_FIT
+ *          constants in mm.h. Returns 0, or -1 if this build does not
+ *          have that policy (the TLSF engine only has its own).
+ */
+int mm_set_policy(int policy) {
+    if(policy < MM_FIRST_FIT || policy > MM_GOOD_FIT) {
+        return -1;
+    }
+#if USE_TLSF
+    if(policy != MM_FIRST_FIT) {
+        return -1;
+    }
+#endif
+    lock_arenas();
+    fit_policy = policy;
+    unlock_arenas();
+    return 0;
+}
+
+/*
+ * mm_set_good_fit - set how hard MM_GOOD_FIT looks for a block
+ *          max_probes is the number of blocks it looks at before it takes
+ *          the best one so far, max_slack the waste (bytes) it is happy with.
+ */
+void mm_set_good_fit(int max_probes, size_t max_slack) {
+    lock_arenas();
+    good_probes = max_probes > 0 ? max_probes : 1;
+    good_slack = max_slack;
+    unlock_arenas();
+}
+
+/*
+ * mm_set_arenas - use n independent arenas (1 .. MAX_ARENAS) from the next
+ *          mm_init on. Returns 0, or -1 if n is out of range.
+ */
+int mm_set_arenas(int n) {
+    if(n < 1 || n > MAX_ARENAS) {
+        return -1;
+    }
+    lock_arenas();
+    want_arenas = n;
+    unlock_arenas();
+    return 0;
+}
+
+/*
+ * mm_set_deferred - turn deferred coalescing with quick lists on (1) or off (0)
+ *          Turning it off frees whatever is on the quick lists right away.
+ */
+void mm_set_deferred(int on) {
+    int i;
+
+    lock_arenas();
+    deferred = on;
+    if(!on) {
+        for(i = 0; i < num_arenas; i++) {
+            arena = &arenas[i];
+            quick_flush();
+        }
+    }
+    unlock_arenas();
+}
+
+/*
+ * mm_get_counts - add up the counters of all arenas since the last mm_init
+ */
+void mm_get_counts(mm_counts_t *counts) {
+    int i;
+
+    memset(counts, 0, sizeof(*counts));
+    lock_arenas();
+    for(i = 0; i < num_arenas; i++) {
+        counts->splits += arenas[i].counts.splits;
+        counts->merges += arenas[i].counts.merges;
+        counts->quick_hits += arenas[i].counts.quick_hits;
+        counts->quick_flushes += arenas[i].counts.quick_flushes;
+        counts->moves += arenas[i].counts.moves;
+        counts->trimmed += arenas[i].counts.trimmed;
+        counts->released += arenas[i].counts.released;
+        counts->zeroed += arenas[i].counts.zeroed;
+        counts->extends += arenas[i].counts.extends;
+    }
+    unlock_arenas();
+}
+
+/*
+ * is_huge - is bp a huge block, one with a mapping of its own. Those are
+ *      the only blocks outside the heap.
+ */
+static inline int is_huge(void *bp)
+{
+    return (size_t)((char *)bp - (char *)mem_heap_lo()) >= MAX_HEAP;
+}
+
+/* is_huge_size - does a request of size bytes get a mapping of its own */
+static inline int is_huge_size(size_t size)
+{
+    return mmap_threshold != 0 && size >= mmap_threshold;
+}
+
+/*
+ * huge_alloc - a mapping of its own for a request of size bytes
+ *      The header right before the payload holds the length of the mapping.
+ */
+static void *huge_alloc(size_t size)
+{
+    return huge_alloc_aligned(DSIZE, size);
+}
+
+/*
+ * huge_alloc_aligned - huge_alloc with the payload align bytes into the
+ *      mapping, which is page aligned, so align can go up to a page
+ */
+static void *huge_alloc_aligned(size_t align, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t len = (size + align + page - 1) / page * page;
+    char *lo;
+
+    if ((lo = mem_map(len)) == NULL) {
+        return NULL;
+    }
+    PUT(lo + align - WSIZE, PACK(len, ALLOC));
+    return lo + align;
+}
+
+/*
+ * huge_base - start of the mapping of a huge block, the payload is at
+ *      most a page in so the page its header is on
+ */
+static inline char *huge_base(void *bp)
+{
+    return (char *)((size_t)HDRP(bp) & ~(mem_pagesize() - 1));
+}
+
+/* huge_free - unmap a huge block */
+static void huge_free(void *bp)
+{
+    mem_unmap(huge_base(bp));
+}
+
+/*
+ * huge_realloc - resize a huge block. One that stays huge is remapped,
+ *      the kernel moves its pages if it has to, one that gets small
+ *      enough for the heap moves there.
+ */
+static void *huge_realloc(void *bp, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t off = (char *)bp - huge_base(bp);    /* DSIZE, or the align of mm_memalign */
+    size_t len = (size + off + page - 1) / page * page;
+    size_t old = GET_SIZE(HDRP(bp));
+    char *lo, *newp;
+
+    /* the new mapping is page aligned too so the payload stays aligned */
+    if (is_huge_size(size)) {
+        if (len == old) {
+            return bp;
+        }
+        if ((lo = mem_remap(huge_base(bp), len)) == NULL) {
+            return NULL;
+        }
+        PUT(lo + off - WSIZE, PACK(len, ALLOC));
+        return lo + off;
+    }
+    if ((newp = mm_malloc(size)) == NULL) {
+        return NULL;
+    }
+    memcpy(newp, bp, size < old - off ? size : old - off);
+    huge_free(bp);
+    return newp;
+}
+
+/*
+ * mm_set_mmap_threshold - requests of at least bytes bytes get a mapping
+ *      of their own from now on, 0 keeps everything in the heap
+ */
+void mm_set_mmap_threshold(size_t bytes) {
+    mmap_threshold = bytes;
+}
+
+/*
+ * mm_set_growth - the heap grows by min up to max bytes at a time, the
+ *          step doubles when an arena hands out ramp bytes per byte freed
+ *          between two extensions (see grow_size). min = max is a fixed step.
+ */
+void mm_set_growth(size_t min, size_t max, unsigned ramp) {
+    int i;
+
+    lock_arenas();
+    grow_min = min > DSIZE ? min & ~(size_t)(DSIZE-1) : DSIZE;
+    grow_max = max > grow_min ? max : grow_min;
+    grow_ramp = ramp > 0 ? ramp : 1;
+    for (i = 0; i < MAX_ARENAS; i++) {
+        arenas[i].step = grow_min;
+    }
+    unlock_arenas();
+}
+
+/*
+ * quick_push - put a block that is being freed on the quick list of its size
+ *          The block stays marked allocated so nobody coalesces with it.
+ *          A list that gets too long flushes all of them.
+ */
+static void quick_push(void *bp) {
+    size_t i = GET_SIZE(HDRP(bp)) / DSIZE;
+
+    *(char **)bp = arena->quick[i];
+    arena->quick[i] = bp;
+    arena->quick_total++;
+    if(++arena->quick_len[i] > QUICK_COUNT) {
+        quick_flush();
+    }
+}
+
+/* quick_pop - take a block of exactly asize bytes off its quick list (there is one) */
+static void *quick_pop(size_t asize) {
+    size_t i = asize / DSIZE;
+    char *bp = arena->quick[i];
+
+    arena->quick[i] = *(char **)bp;
+    arena->quick_len[i]--;
+    arena->quick_total--;
+    arena->counts.quick_hits++;
+    return bp;
+}
+
+/*
+ * quick_flush - free every block on the quick lists for real, so they
+ *          coalesce with each other and the rest of the free blocks
+ */
+static void quick_flush(void) {
+    size_t i;
+    char *bp;
+
+    if(arena->quick_total == 0) {
+        return;
+    }
+    arena->counts.quick_flushes++;
+    for(i = 0; i < QUICK_BINS; i++) {
+        while((bp = arena->quick[i]) != NULL) {
+            arena->quick[i] = *(char **)bp;
+            free_block(bp);
+        }
+        arena->quick_len[i] = 0;
+    }
+    arena->quick_total = 0;
+}
+
+/*
+ * find_or_flush - find_block, but if nothing fits and there are deferred
+ *          frees, coalesce those first and look again
+ */
+static void *find_or_flush(size_t asize) {
+    void *bp;
+
+    if((bp = find_block(asize)) == NULL && arena->quick_total > 0) {
+        quick_flush();
+        bp = find_block(asize);
+    }
+    return bp;
+}
+/*
+ * place - Place block of asize bytes at start of free block bp
+ *          and split if remainder would be at least minimum block size
+ *
+ * Pretty much the same implementation as with implicit list but we remove
+ * from our free list and coalesce.
+ *
+ * If our free block is large enough to hold a block of asize sys and our minimum
+ * block size, we split the block into one allocated and one free block.
+ * We remove the old free block and coalesce where the new free block is 
+ * inserted into the free list
+ *
+ * If our free block is not large enough, we just allocate it and remove it frmo
+ * the free list
+ */
+
+/* $begin mmplace */
+static void place(void *bp, size_t asize){
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+
+    /* the block has to leave its list before its size changes */
+    removeBlock(bp);
+    if ((csize - asize) >= MIN_BLOCK) {
+        arena->counts.splits++;
+        PUT(HDRP(bp), PACK(asize, prev_alloc | ALLOC));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(csize-asize, PREV_ALLOC));
+        /* same footer as before, a released block stays released */
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(csize-asize, GET(FTRP(NEXT_BLKP(bp))) & RELEASED));
+        coalesce(NEXT_BLKP(bp));
+    }
+    else {
+        PUT(HDRP(bp), PACK(csize, prev_alloc | ALLOC));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+    arena->placed += GET_SIZE(HDRP(bp));
+    arena->req = arena->req - arena->req / GROW_REQS + asize / GROW_REQS;
+    used(bp);
+}
+/* $end mmplace */
+
+/*
+ * carve - place up to n blocks of asize bytes one after the other at the
+ *      start of the free block bp, like that many places in a row, but the
+ *      free block only leaves its list once and what is left of it goes
+ *      back once. The last block takes a remainder too small to be a block.
+ *      Returns how many blocks it placed, bp fits at least one.
+ */
+static int carve(void *bp, size_t asize, int n, void **out){
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t rest, bsize;
+    int i, k;
+
+    k = (csize / asize < (size_t)n) ? (int)(csize / asize) : n;
+    rest = csize - k * asize;
+    removeBlock(bp);
+    for (i = 0; i < k; i++) {
+        bsize = (i == k - 1 && rest < MIN_BLOCK) ? asize + rest : asize;
+        PUT(HDRP(bp), PACK(bsize, prev_alloc | ALLOC));
+        prev_alloc = PREV_ALLOC;
+        out[i] = bp;
+        bp = NEXT_BLKP(bp);
+    }
+    arena->placed += k * asize;
+    arena->req = arena->req - arena->req / GROW_REQS + asize / GROW_REQS;
+    used(out[k - 1]);
+    if (rest >= MIN_BLOCK) {
+        arena->counts.splits += k;
+        PUT(HDRP(bp), PACK(rest, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(rest, GET(FTRP(bp)) & RELEASED));
+        coalesce(bp);
+    }
+    else {
+        arena->counts.splits += k - 1;
+        SET_PREV_ALLOC(HDRP(bp));
+    }
+    return k;
+}
+
+
+/*
+ * coalesce - boundary tag coalescing. Return ptr to coalesced block
+ *      Given a free block bp we check if there are adjacent free blocks
+ *      if there are we "merge" them into a larger free block
+ *      and insert into the free list
+ *      The caller has already cleared the prev allocated bit of the next block.
+ *      The merged block always follows an allocated block.
+ */
+static void *coalesce(void *bp){
+
+    /* checks if next block is allocated*/
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+
+    /* checks if previous block is allocated, the prologue is, so this
+     * also covers the front of the heap */
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t released;            /* the merged block keeps RELEASED of any part, see free_block_size */
+    /* Case 1 - Both adjacent blocks are allocated 
+	*			thus no coalescing is possible
+	*/
+	if(prev_alloc && next_alloc) {
+		insertBlock(bp);
+		return bp;
+    }
+    /* Case 2 - only the next block is free
+    *            here we remove the next block from the free list
+    *            and make a new block with the combined size of
+    *            current block and next block
+    */
+    else if (prev_alloc && !next_alloc) {                  
+        arena->counts.merges++;
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        released = (GET(FTRP(bp)) | GET(FTRP(NEXT_BLKP(bp)))) & RELEASED;
+        removeBlock(NEXT_BLKP(bp));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, released));
+        insertBlock(bp);
+        return bp;
+    }
+    /* Case 3 - only the prevous block is free
+    *        here we remove from the free list
+    *        and make a new block with combined size of
+    *        current block and previous block
+    */  
+    else if (!prev_alloc && next_alloc) {               
+        arena->counts.merges++;
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        released = (GET(FTRP(bp)) | GET((char *)bp - DSIZE)) & RELEASED;
+        bp = PREV_BLKP(bp);
+        removeBlock(bp);
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, released));
+        insertBlock(bp);
+        return bp;
+    }
+    /* Case 4 - both next and previous blocks are free
+    *        here we remove both next and previous blocks
+    *        from the free list and make a new block with a combined
+    *        size of previous, current and next blocks
+    */ 
+    else  {                
+        arena->counts.merges += 2;
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        released = (GET((char *)bp - DSIZE) | GET(FTRP(bp)) | GET(FTRP(NEXT_BLKP(bp)))) & RELEASED;
+        removeBlock(PREV_BLKP(bp));
+        removeBlock(NEXT_BLKP(bp));
+        bp = PREV_BLKP(bp);
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, released));
+        insertBlock(bp);
+        return bp;
+    }
+
+}
+
+#if USE_TLSF
+/* fls_size - index of the most significant set bit of size (size > 0) */
+static inline int fls_size(size_t size)
+{
+    return (int)sizeof(size_t)*8 - 1 - __builtin_clzl(size);
+}
+
+/*
+ * tlsf_mapping - first and second level index of the list holding size bytes
+ *      sizes below 1 << FL_SHIFT are split linearly in first level 0,
+ *      above that fl is the power of two and sl the next SL_LOG2 bits.
+ */
+static inline void tlsf_mapping(size_t size, int *fl, int *sl)
+{
+    if (size < (1 << FL_SHIFT)) {
+        *fl = 0;
+        *sl = (int)(size / ((1 << FL_SHIFT) / SL_COUNT));
+    }
+    else {
+        int f = fls_size(size);
+        *sl = (int)(size >> (f - SL_LOG2)) ^ SL_COUNT;
+        *fl = f - FL_SHIFT + 1;
+    }
+}
+
+/* size_class - flat index fl*SL_COUNT+sl of the list that holds blocks of size bytes */
+static int size_class(size_t size)
+{
+    int fl, sl;
+
+    tlsf_mapping(size, &fl, &sl);
+    return fl * SL_COUNT + sl;
+}
+#else
+/*
+ * size_class - returns the index of the free list that holds blocks of size bytes
+ *      class 0 is everything up to MIN_BLOCK and the limit doubles for every
+ *      class after that. The last class has no upper limit.
+ */
+static int size_class(size_t size)
+{
+    int i = 0;
+    size_t limit = MIN_BLOCK;
+
+    while (i < NUM_CLASSES - 1 && size > limit) {
+        limit <<= 1;
+        i++;
+    }
+    return i;
+}
+#endif
+
+/*insert a block into the free list of its size class*/
+static void insertBlock(void *bp)
+{
+    char **listp;
+    int i;
+
+    if(bp == NULL) {
+        return;
+    }
+    if(touch_on) {
+        touch(bp);
+    }
+#if !USE_TLSF
+    if(GET_SIZE(HDRP(bp)) > TREE_MIN) {
+        tree_insert(bp);
+        return;
+    }
+#endif
+    i = size_class(GET_SIZE(HDRP(bp)));
+    listp = &arena->seg_lists[i];
+#if USE_TLSF
+    /* the list is non empty from now on */
+    arena->fl_bitmap |= 1UL << (i / SL_COUNT);
+    arena->sl_bitmap[i / SL_COUNT] |= 1U << (i % SL_COUNT);
+#endif
+    /* when we insert a free block into the free list we insert
+     * it at the front of the list and
+            make the new front->next point to old front
+            make old front->prev point to new front (if there is one)
+            make the new front->prev point to NULL
+            make the start of the free list point to new front */
+    NEXT_FREE(bp) = *listp;
+    if(*listp != NULL) {
+        PREV_FREE(*listp) = bp;
+    }
+    PREV_FREE(bp) = NULL;
+    *listp = bp;
+}
+
+
+/*remove block from the free list of its size class
+ * the size in the header must still be the one it was inserted with */
+static void removeBlock(void *bp)
+{
+    /* when removing from the list we have two cases:
+     *  1) we are removing from the front of the list
+                in this case we make the start of the list skip
+                the block thats about to be removed and point to
+                the next block in the list
+     *  2) we're not removing from the front of the list
+                in this case we "cross the wires" so to speak and
+                skip over the block that's about to be deleted.
+                If we have a prev, curr and next pointer we make
+                prev point to next and next point to prev so we skip
+                over our curr pointer.
+     * large blocks are in the tree instead.
+    */
+    if(touch_on) {
+        touch(bp);
+    }
+#if !USE_TLSF
+    if(GET_SIZE(HDRP(bp)) > TREE_MIN) {
+        tree_remove(bp);
+        return;
+    }
+#endif
+#if !USE_TLSF
+    /* the rover can't stay on a block that leaves the list */
+    if(arena->rovers[size_class(GET_SIZE(HDRP(bp)))] == bp) {
+        arena->rovers[size_class(GET_SIZE(HDRP(bp)))] = NEXT_FREE(bp);
+    }
+#endif
+    //case 1
+    if(!PREV_FREE(bp)) {
+        int i = size_class(GET_SIZE(HDRP(bp)));
+
+        arena->seg_lists[i] = NEXT_FREE(bp);
+#if USE_TLSF
+        /* clear the bitmaps when we empty the list */
+        if(arena->seg_lists[i] == NULL) {
+            arena->sl_bitmap[i / SL_COUNT] &= ~(1U << (i % SL_COUNT));
+            if(arena->sl_bitmap[i / SL_COUNT] == 0) {
+                arena->fl_bitmap &= ~(1UL << (i / SL_COUNT));
+            }
+        }
+#endif
+    }
+    //case 2
+    else {
+        NEXT_FREE(PREV_FREE(bp)) = NEXT_FREE(bp);
+    }
+    if(NEXT_FREE(bp) != NULL) {
+        PREV_FREE(NEXT_FREE(bp)) = PREV_FREE(bp);
+    }
+}
+
+
+#if !USE_TLSF
+/*
+ * splay - top down splay of the tree t for size, returns the new root
+ *      The new root is the block of that size if there is one, otherwise
+ *      the last block on the search path, which is either the biggest block
+ *      smaller than size or the smallest block bigger than it. l and r
+ *      collect the parts smaller and bigger than size, which become the
+ *      subtrees of the new root at the end. The dummy node N is just two
+ *      words so TREE_LEFT and TREE_RIGHT work on it.
+ */
+static char *splay(char *t, size_t size)
+{
+    char *N[2] = {NULL, NULL};
+    char *l = (char *)N;
+    char *r = (char *)N;
+    char *y;
+
+    if (t == NULL) {
+        return NULL;
+    }
+    for (;;) {
+        if (size < GET_SIZE(HDRP(t))) {
+            if (TREE_LEFT(t) == NULL) {
+                break;
+            }
+            if (size < GET_SIZE(HDRP(TREE_LEFT(t)))) {      /* rotate right */
+                y = TREE_LEFT(t);
+                TREE_LEFT(t) = TREE_RIGHT(y);
+                TREE_RIGHT(y) = t;
+                t = y;
+                if (TREE_LEFT(t) == NULL) {
+                    break;
+                }
+            }
+            TREE_LEFT(r) = t;                                /* link right */
+            r = t;
+            t = TREE_LEFT(t);
+        }
+        else if (size > GET_SIZE(HDRP(t))) {
+            if (TREE_RIGHT(t) == NULL) {
+                break;
+            }
+            if (size > GET_SIZE(HDRP(TREE_RIGHT(t)))) {     /* rotate left */
+                y = TREE_RIGHT(t);
+                TREE_RIGHT(t) = TREE_LEFT(y);
+                TREE_LEFT(y) = t;
+                t = y;
+                if (TREE_RIGHT(t) == NULL) {
+                    break;
+                }
+            }
+            TREE_RIGHT(l) = t;                               /* link left */
+            l = t;
+            t = TREE_RIGHT(t);
+        }
+        else {
+            break;
+        }
+    }
+    /* put it back together */
+    TREE_RIGHT(l) = TREE_LEFT(t);
+    TREE_LEFT(r) = TREE_RIGHT(t);
+    TREE_LEFT(t) = TREE_RIGHT(N);
+    TREE_RIGHT(t) = TREE_LEFT(N);
+    return t;
+}
+
+/*
+ * tree_insert - Insert a large free block into the tree
+ *      If its size is already in the tree the block joins the chain of
+ *      that node, otherwise it becomes the new root.
+ */
+static void tree_insert(char *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *t;
+
+    CHAIN_NEXT(bp) = NULL;
+    CHAIN_PREV(bp) = NULL;
+    if (arena->tree_root == NULL) {
+        TREE_LEFT(bp) = NULL;
+        TREE_RIGHT(bp) = NULL;
+        arena->tree_root = bp;
+        return;
+    }
+
+    t = splay(arena->tree_root, size);
+    if (size == GET_SIZE(HDRP(t))) {
+        /* same size, put it in the chain right after the node */
+        CHAIN_NEXT(bp) = CHAIN_NEXT(t);
+        CHAIN_PREV(bp) = t;
+        if (CHAIN_NEXT(t) != NULL) {
+            CHAIN_PREV(CHAIN_NEXT(t)) = bp;
+        }
+        CHAIN_NEXT(t) = bp;
+        arena->tree_root = t;
+        return;
+    }
+    if (size < GET_SIZE(HDRP(t))) {
+        TREE_LEFT(bp) = TREE_LEFT(t);
+        TREE_RIGHT(bp) = t;
+        TREE_LEFT(t) = NULL;
+    }
+    else {
+        TREE_RIGHT(bp) = TREE_RIGHT(t);
+        TREE_LEFT(bp) = t;
+        TREE_RIGHT(t) = NULL;
+    }
+    arena->tree_root = bp;
+}
+
+/*
+ * tree_remove - Remove a large free block from the tree
+ *      A block in a chain just gets unlinked. A tree node is splayed to
+ *      the root and then replaced by the first block of its chain, or
+ *      if it has none, by the biggest block of its left subtree.
+ */
+static void tree_remove(char *bp)
+{
+    char *t;
+
+    if (CHAIN_PREV(bp) != NULL) {
+        CHAIN_NEXT(CHAIN_PREV(bp)) = CHAIN_NEXT(bp);
+        if (CHAIN_NEXT(bp) != NULL) {
+            CHAIN_PREV(CHAIN_NEXT(bp)) = CHAIN_PREV(bp);
+        }
+        return;
+    }
+
+    t = splay(arena->tree_root, GET_SIZE(HDRP(bp)));
+    if (CHAIN_NEXT(t) != NULL) {
+        char *c = CHAIN_NEXT(t);
+
+        TREE_LEFT(c) = TREE_LEFT(t);
+        TREE_RIGHT(c) = TREE_RIGHT(t);
+        CHAIN_PREV(c) = NULL;
+        arena->tree_root = c;
+    }
+    else if (TREE_LEFT(t) == NULL) {
+        arena->tree_root = TREE_RIGHT(t);
+    }
+    else {
+        /* everything on the left is smaller, so the splay brings up its
+         * biggest block, which has no right child */
+        arena->tree_root = splay(TREE_LEFT(t), GET_SIZE(HDRP(t)));
+        TREE_RIGHT(arena->tree_root) = TREE_RIGHT(t);
+    }
+}
+
+/*
+ * tree_best_fit - Smallest free block in the tree with at least asize bytes
+ *      After splaying for asize the root is that block, or the biggest block
+ *      that is too small. In the second case everything in its right subtree
+ *      is bigger than asize and splaying that subtree brings up the smallest.
+ *      We hand out a block from the chain when there is one, those are
+ *      cheaper to remove than the node.
+ */
+static void *tree_best_fit(size_t asize)
+{
+    char *t;
+
+    if (arena->tree_root == NULL) {
+        return NULL;
+    }
+    t = arena->tree_root = splay(arena->tree_root, asize);
+    if (GET_SIZE(HDRP(t)) < asize) {
+        if (TREE_RIGHT(t) == NULL) {
+            return NULL;
+        }
+        t = TREE_RIGHT(arena->tree_root) = splay(TREE_RIGHT(arena->tree_root), asize);
+    }
+    return CHAIN_NEXT(t) != NULL ? CHAIN_NEXT(t) : t;
+}
+
+/*
+ * tree_check - checks that every node of t is a free block with a size in
+ *      (lo, hi), that the subtrees are ordered and that the chains only
+ *      hold free blocks of the size of their node. Returns 0 on an error.
+ */
+static int tree_check(char *t, size_t lo, size_t hi)
+{
+    char *c;
+    size_t size;
+
+    if (t == NULL) {
+        return 1;
+    }
+    size = GET_SIZE(HDRP(t));
+    if (GET_ALLOC(HDRP(t)) || size <= lo || size >= hi || CHAIN_PREV(t) != NULL) {
+        printf("Tree node %p of size %zu is out of place\n", t, size);
+        return 0;
+    }
+    for (c = CHAIN_NEXT(t); c != NULL; c = CHAIN_NEXT(c)) {
+        if (GET_ALLOC(HDRP(c)) || GET_SIZE(HDRP(c)) != size) {
+            printf("Block %p in the chain of %p does not belong there\n", c, t);
+            return 0;
+        }
+    }
+    return tree_check(TREE_LEFT(t), lo, size) && tree_check(TREE_RIGHT(t), size, hi);
+}
+
+/* tree_contains - is the free block bp in the tree (without splaying it) */
+static int tree_contains(char *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    char *t = arena->tree_root;
+    char *c;
+
+    while (t != NULL && GET_SIZE(HDRP(t)) != size) {
+        t = size < GET_SIZE(HDRP(t)) ? TREE_LEFT(t) : TREE_RIGHT(t);
+    }
+    for (c = t; c != NULL; c = CHAIN_NEXT(c)) {
+        if (c == bp) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * tree_mark - mark_lists for the tree t, every node and the chain behind
+ *      it. A block that is marked already ends that part of the walk.
+ */
+static int tree_mark(char *t, int on)
+{
+    char *c;
+    int is_good = 1;
+
+    if (t == NULL) {
+        return 1;
+    }
+    for (c = t; c != NULL; c = CHAIN_NEXT(c)) {
+        if (list_marked(c) < 0 || GET_ALLOC(HDRP(c)) || list_marked(c) == on) {
+            if (on) {
+                printf("Block %p in the tree is %s\n", c,
+                       list_marked(c) < 0 ? "not in the heap" :
+                       GET_ALLOC(HDRP(c)) ? "not free" : "in it twice");
+                is_good = 0;
+            }
+            if (c == t) {
+                return is_good;
+            }
+            break;
+        }
+        list_mark(c, on);
+    }
+    return tree_mark(TREE_LEFT(t), on) & tree_mark(TREE_RIGHT(t), on) & is_good;
+}
+#endif
+
+static void printblock(void *bp) {
+    size_t hsize, halloc, fsize, falloc;
+
+
+    hsize = GET_SIZE(HDRP(bp));
+    halloc = GET_ALLOC(HDRP(bp));  
+
+    if (hsize == 0) {
+        printf("%p: end of heap\n", bp);
+        return;
+    }
+    if (halloc) {
+        printf("%p: header: [%zu:%c%c]\n", bp, hsize,
+          (GET_PREV_ALLOC(HDRP(bp)) ? 'p' : '-'), 'a');
+        return;
+    }
+
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));  
+    printf("%p: header: [%zu:%c%c] footer: [%zu:%c]\n", bp, 
+      hsize, (GET_PREV_ALLOC(HDRP(bp)) ? 'p' : '-'), 'f', 
+      fsize, (falloc ? 'a' : 'f'));
+}
+
+
+static int checkblock(void *bp) {
+    int is_good = 1;
+
+    if ((size_t)bp % DSIZE) {
+        printf("Error: %p is not doubleword aligned\n", bp);
+        is_good = 0;
+    }
+    if (!GET_ALLOC(HDRP(bp)) && (GET_SIZE(HDRP(bp)) != GET_SIZE(FTRP(bp)) || GET_ALLOC(FTRP(bp)))) {
+        printf("Error: %p header does not match footer\n", bp);
+        is_good = 0;
+    }
+    return is_good;
+}
+
+/*
+ * region_grow - Make room for an object of size bytes (DSIZE aligned) that
+ *      doesn't fit in the newest chunk of region r. A big one gets a chunk
+ *      of its own behind the newest, anything else goes first in a new
+ *      chunk that becomes the newest. NULL if out of memory.
+ */
+static void *region_grow(mm_region_t *r, size_t size)
+{
+    size_t actual;
+    char *c;
+
+    if (r->chunks != NULL && size > r->chunk / REGION_BIG) {
+        if ((c = mm_malloc(DSIZE + size)) == NULL) {
+            return NULL;
+        }
+        *(char **)c = *(char **)r->chunks;
+        *(char **)r->chunks = c;
+        return c + DSIZE;
+    }
+    if ((c = mm_malloc_sized(MAX(r->chunk, DSIZE + size), &actual)) == NULL) {
+        return NULL;
+    }
+    *(char **)c = r->chunks;
+    r->chunks = c;
+    r->next = c + DSIZE + size;
+    r->end = c + actual;
+    return c + DSIZE;
+}
+
+/*
+ * pool_grow - Get a new chunk for pool p, which has no free objects left.
+ *      The first object goes to the caller, the others on the free stack,
+ *      lowest address on top. NULL if out of memory.
+ */
+static void *pool_grow(mm_pool_t *p)
+{
+    size_t want = MAX(POOL_CHUNK, p->align + POOL_MIN * p->size);
+    size_t n;
+    char *c, *bp;
+
+    if (p->align > DSIZE) {
+        c = mm_memalign(p->align, want);
+    }
+    else {
+        c = mm_malloc(want);
+    }
+    if (c == NULL) {
+        return NULL;
+    }
+    *(char **)c = p->chunks;
+    p->chunks = c;
+
+    /* whatever the chunk can hold beyond want is objects too */
+    n = (mm_usable_size(c) - p->align) / p->size;
+    for (bp = c + p->align + (n - 1) * p->size; bp > c + p->align; bp -= p->size) {
+        *(char **)bp = p->free;
+        p->free = bp;
+    }
+    return bp;
+}
+
+/* handles_reset - mm_init's part for the handles, nothing is movable yet */
+static void handles_reset(void)
+{
+    pthread_mutex_lock(&handle_lock);
+    /* mem_reset_brk unmaps the table with the rest of the old run's maps */
+    if (hslots != NULL && mem_is_mapped(hslots, hslots)) {
+        mem_unmap(hslots);
+    }
+    hslots = NULL;
+    hslots_cap = hslots_used = hslot_free = 0;
+    htop = hdense = hscan = mem_hheap_lo();
+    hend = htop + mem_hheapsize();
+    hhole = hskipped = NULL;
+    pthread_mutex_unlock(&handle_lock);
+}
+
+/*
+ * hcompact - One bounded piece of the sweep over the movable heap (see
+ *      above). Every block it looks at counts DSIZE against budget and
+ *      every block it moves its size. Returns 0 once there is nothing to
+ *      do, 1 if the budget ran out first. handle_lock is held.
+ */
+static int hcompact(size_t budget)
+{
+    size_t size, cut;
+    hslot_t *slot;
+    char *b;
+
+    while (budget > 0) {
+        if (hscan == htop) {
+            /* the gap is the end of the heap now, cut it off */
+            htop = hscan = hdense;
+            if ((size_t)(hend - htop) >= 2 * HCHUNK) {
+                cut = hend - htop - HCHUNK;
+                if (mem_hsbrk(-(intptr_t)cut) != (void *)-1) {
+                    hend -= cut;
+                }
+            }
+            if (hhole == NULL) {
+                return 0;
+            }
+            hdense = hscan = hhole;
+            hhole = NULL;
+            /* this sweep gets to the gaps it left before on its own */
+            if (hskipped >= hdense) {
+                hskipped = NULL;
+            }
+            continue;
+        }
+        b = hscan;
+        size = GET_SIZE(b);
+        budget -= budget > DSIZE ? DSIZE : budget;
+        if (!GET_ALLOC(b)) {
+            hscan += size;
+            continue;
+        }
+        slot = &hslots[GET(b + WSIZE)];
+        if (slot->locks > 0) {
+            /* can't move it, the gap in front stays a free block */
+            if (hdense < hscan) {
+                hgap_close();
+                if (hskipped == NULL || hdense < hskipped) {
+                    hskipped = hdense;
+                }
+            }
+            hdense = hscan = b + size;
+            continue;
+        }
+        if (hdense < b) {
+            memmove(hdense, b, size);
+            slot->bp = hdense + DSIZE;
+            budget -= budget > size ? size : budget;
+        }
+        hdense += size;
+        hscan += size;
+    }
+    hgap_close();
+    return 1;
+}
+
+/* hgap_close - Make the gap of the sweep a free block so the heap can be walked */
+static void hgap_close(void)
+{
+    if (hdense < hscan) {
+        PUT(hdense, PACK(hscan - hdense, 0));
+    }
+}
+
+/* hhole_note - b was freed below where the sweep is, the next one starts there */
+static inline void hhole_note(char *b)
+{
+    if (hhole == NULL || b < hhole) {
+        hhole = b;
+    }
+}
+
+/*
+ * alloc_aligned - Allocate a block of asize bytes whose payload is aligned
+ *      to align bytes (a power of two bigger than DSIZE).
+ *      We look for a block that is big enough to leave a free block in front
+ *      of the aligned payload, split that gap off and give it back to the
+ *      free lists, and then place the block as usual.
+ */
+static void *alloc_aligned(size_t align, size_t asize)
+{
+    size_t need = asize + align + MIN_BLOCK;
+    size_t csize, gap, released;
+    char *bp, *ap;
+
+    if ((bp = find_or_flush(need)) == NULL) {
+        if ((bp = extend_heap(grow_size(need) / WSIZE)) == NULL) {
+            return NULL;
+        }
     }
+    removeBlock(bp);
+    csize = GET_SIZE(HDRP(bp));
 
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
+    /* the gap in front has to be a block of its own, or nothing */
+    ap = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+    if (ap != bp && (size_t)(ap - bp) < MIN_BLOCK) {
+        ap += align;
+    }
+    gap = ap - bp;
+    released = GET(FTRP(bp)) & RELEASED;
+    if (gap) {
+        PUT(HDRP(bp), PACK(gap, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(gap, released));
+        insertBlock(bp);
+    }
+    PUT(HDRP(ap), PACK(csize - gap, gap ? 0 : PREV_ALLOC));
+    PUT(FTRP(ap), PACK(csize - gap, released));
+    insertBlock(ap);
+    place(ap, asize);
+    return ap;
+}
 
-    return coalesce(bp);
+/* is_slab - is bp a tiny object that lives in a slab */
+static inline int is_slab(void *bp)
+{
+    size_t page = heap_page(bp);
+
+    return page <= __atomic_load_n(&page_map_hi, __ATOMIC_RELAXED) && page_map[page] == PAGE_SLAB;
 }
-/* $end mmextendheap */
 
+/* slab_of - the slab header of a tiny object, found by masking its address */
+static inline slab_t *slab_of(void *bp)
+{
+    return (slab_t *)((size_t)bp & ~(size_t)(SLAB_SIZE - 1));
+}
 
 /*
- * find_fit - Find a fit for a block with asize bytes
- * 
- * We use a first fit search where we traverse our entire free list
- * and find the first block that is big enough to hold a payload of asize.
- * If no such fit is found we return NULL
+ * slab_new - Get a new slab for class cls from the heap
+ *      The slab is an allocated block with a page aligned payload of
+ *      SLAB_SIZE bytes. We mark the page in the page map and set up
+ *      the header with every object free.
  */
-static void *find_fit(size_t asize){
-    void *bp;
-    for (bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREE(bp) ){
-        if (asize <= (size_t)GET_SIZE(HDRP(bp)) ) {
-            return bp;
-        }
+static slab_t *slab_new(int cls)
+{
+    slab_t *sp;
+
+    if ((sp = alloc_aligned(SLAB_SIZE, adjust_and_align(SLAB_SIZE))) == NULL) {
+        return NULL;
     }
+    page_map[heap_page(sp)] = PAGE_SLAB;
 
-    return NULL;
+    memset(sp->used, 0, sizeof(sp->used));
+    sp->cls = cls;
+    sp->nobjs = (SLAB_SIZE - (SLAB_OBJS(sp) - (char *)sp)) / ((cls + 1) * DSIZE);
+    sp->nfree = sp->nobjs;
+    sp->hint = 0;
+    sp->prev = NULL;
+    sp->next = arena->slab_lists[cls];
+    if (sp->next != NULL) {
+        sp->next->prev = sp;
+    }
+    arena->slab_lists[cls] = sp;
+    return sp;
 }
 
-/*Find_best_fit - best fit algorithm for finding a free block
- *          here we traverse the free list and find the free block
- *          with the closest size to aSize
- *
- * This algorithm did worse in performance than the first fit one
- * so we are not using this one now 
+/* slab_unlink - take a slab out of the list of slabs with free objects */
+static void slab_unlink(slab_t *sp)
+{
+    if (sp->prev != NULL) {
+        sp->prev->next = sp->next;
+    }
+    else {
+        arena->slab_lists[sp->cls] = sp->next;
+    }
+    if (sp->next != NULL) {
+        sp->next->prev = sp->prev;
+    }
+}
+
+/*
+ * slab_alloc - Allocate a tiny object of size bytes (0 < size < SLAB_MAX)
+ *      We take the first slab of the class that has a free object, or
+ *      make a new one, and grab the first clear bit in its bitmap.
+ *      A slab that fills up leaves the list.
  */
-static void *find_best_fit(size_t asize) {
-    /*testing best fit */
-    void *bp;
-    void *best = NULL;
-    
-    
-    for(bp = free_listp; GET_ALLOC(HDRP(bp)) == 0; bp = NEXT_FREE(bp)) {
-        size_t currSize = GET_SIZE(HDRP(bp));
-        if(asize == currSize) {
-            return bp;
+static void *slab_alloc(size_t size)
+{
+    int cls = (size + DSIZE - 1) / DSIZE - 1;
+    slab_t *sp = arena->slab_lists[cls];
+    int w, bit;
+
+    if (sp == NULL && (sp = slab_new(cls)) == NULL) {
+        return NULL;
+    }
+
+    /* words before the hint are full, so start looking there */
+    for (w = sp->hint; sp->used[w] == ~0U; w++)
+        ;
+    bit = __builtin_ctz(~sp->used[w]);
+    sp->used[w] |= 1U << bit;
+    sp->hint = w;
+
+    if (--sp->nfree == 0) {
+        slab_unlink(sp);
+    }
+    return SLAB_OBJS(sp) + (size_t)(w * 32 + bit) * (sp->cls + 1) * DSIZE;
+}
+
+/*
+ * slab_free - Give a tiny object back to its slab
+ *      A full slab goes back on the list of its class. A slab that becomes
+ *      empty is freed back to the heap, unless it is the only slab left in
+ *      the list, then we keep it around so a malloc/free pair doesn't make
+ *      and destroy a slab every time.
+ */
+static void slab_free(void *bp)
+{
+    slab_t *sp = slab_of(bp);
+    size_t i = ((char *)bp - SLAB_OBJS(sp)) / ((sp->cls + 1) * DSIZE);
+
+    sp->used[i / 32] &= ~(1U << (i % 32));
+    if (i / 32 < sp->hint) {
+        sp->hint = i / 32;
+    }
+
+    if (sp->nfree++ == 0) {
+        sp->prev = NULL;
+        sp->next = arena->slab_lists[sp->cls];
+        if (sp->next != NULL) {
+            sp->next->prev = sp;
         }
-        else if(asize < currSize) {
-            if(best == NULL || GET_SIZE(HDRP(bp)) < GET_SIZE(HDRP(bp))) {
-                best = bp;
+        arena->slab_lists[sp->cls] = sp;
+    }
+    if (sp->nfree == sp->nobjs && (sp->prev != NULL || sp->next != NULL)) {
+        slab_unlink(sp);
+        page_map[heap_page(sp)] = 0;
+        do_free(sp);
+    }
+}
+
+/*
+ * tcache_flush - give every block in the calling thread's cache back to the heap
+ *      Runs when a thread exits (as the destructor of tcache_key). Blocks of
+ *      an older heap are just forgotten.
+ */
+static void tcache_flush(void *arg)
+{
+    tcache_t *tc = arg;
+    int i;
+
+    for (i = 0; i < TCACHE_BINS; i++) {
+        while (tc->bins[i] != NULL) {
+            char *bp = tc->bins[i];
+
+            tc->bins[i] = *(char **)bp;
+            if (tc->epoch == __atomic_load_n(&heap_epoch, __ATOMIC_RELAXED)) {
+                arena_t *a = arena_of(bp);
+
+                pthread_mutex_lock(&a->lock);
+                arena = a;
+                do_free(bp);
+                pthread_mutex_unlock(&a->lock);
             }
         }
+        tc->counts[i] = 0;
     }
-    
-    return best;
+}
 
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, tcache_flush);
 }
+
 /*
- * place - Place block of asize bytes at start of free block bp
- *          and split if remainder would be at least minimum block size
- *
- * Pretty much the same implementation as with implicit list but we remove
- * from our free list and coalesce.
- *
- * If our free block is large enough to hold a block of asize sys and our minimum
- * block size, we split the block into one allocated and one free block.
- * We remove the old free block and coalesce where the new free block is 
- * inserted into the free list
- *
- * If our free block is not large enough, we just allocate it and remove it frmo
- * the free list
+ * tcache_ready - counts the calling thread the first time it gets here,
+ *      hands it an arena, and drops the cache if the heap was reset under it. Returns 1 if
+ *      the caches are in use.
  */
+static inline int tcache_ready(void)
+{
+    unsigned epoch = __atomic_load_n(&heap_epoch, __ATOMIC_RELAXED);
 
-/* $begin mmplace */
-static void place(void *bp, size_t asize){
-    size_t csize = GET_SIZE(HDRP(bp));
+    if (!tcache.registered) {
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, &tcache);
+        tcache.registered = 1;
+        tcache.arena_no = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&threads_seen, 1, __ATOMIC_RELAXED);
+    }
+    if (__atomic_load_n(&threads_seen, __ATOMIC_RELAXED) < 2) {
+        return 0;
+    }
+    if (tcache.epoch != epoch) {
+        memset(tcache.bins, 0, sizeof(tcache.bins));
+        memset(tcache.counts, 0, sizeof(tcache.counts));
+        tcache.epoch = epoch;
+    }
+    return 1;
+}
 
-    if ((csize - asize) >= (DSIZE+OVERHEAD)) {
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
-        removeBlock(bp);
-        bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(csize-asize, 0));
-        PUT(FTRP(bp), PACK(csize-asize, 0));
-        coalesce(bp);
+/*
+ * tcache_get - a cached block for a request of size bytes, or NULL
+ *      Blocks are cached by exact size, so this only hits when a block of
+ *      the size the heap would have made is in the cache.
+ */
+static void *tcache_get(size_t size)
+{
+    int i;
+    char *bp;
+
+    if (!tcache_ready()) {
+        return NULL;
+    }
+    if (size < SLAB_MAX) {
+        i = (size + DSIZE - 1) / DSIZE - 1;
+    }
+    else if (size <= TCACHE_MAX - OVERHEAD) {
+        i = SLAB_CLASSES + adjust_and_align(size) / DSIZE;
     }
     else {
-        PUT(HDRP(bp), PACK(csize, 1));
-        PUT(FTRP(bp), PACK(csize, 1));
-        removeBlock(bp);
+        return NULL;
+    }
+    if ((bp = tcache.bins[i]) != NULL) {
+        tcache.bins[i] = *(char **)bp;
+        tcache.counts[i]--;
     }
+    return bp;
 }
-/* $end mmplace */
-
 
 /*
- * coalesce - boundary tag coalescing. Return ptr to coalesced block
- *      Given a free block bp we check if there are adjacent free blocks
- *      if there are we "merge" them into a larger free block
- *      and insert into the free list
+ * tcache_put - put a block that is being freed in the thread cache
+ *      Returns 0 if the cache is off, the block is too big or its bin is
+ *      full, then the caller has to free it for real.
  */
-static void *coalesce(void *bp){
-
-    /* checks if next block is allocated*/
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+static int tcache_put(void *bp)
+{
+    int i;
 
-    /* checks if previous block is allocated or if we are at the front of the heap */
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))) || PREV_BLKP(bp) == bp;
-    size_t size = GET_SIZE(HDRP(bp));
-    /* Case 1 - Both adjacent blocks are allocated 
-	*			thus no coalescing is possible
-	*/
-	if(prev_alloc && next_alloc) {
-		insertBlock(bp);
-		return bp;
+    if (!tcache_ready()) {
+        return 0;
     }
-    /* Case 2 - only the next block is free
-    *            here we remove the next block from the free list
-    *            and make a new block with the combined size of
-    *            current block and next block
-    */
-    else if (prev_alloc && !next_alloc) {                  
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        removeBlock(NEXT_BLKP(bp));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
-        insertBlock(bp);
-        return bp;
+    if (is_slab(bp)) {
+        i = slab_of(bp)->cls;
     }
-    /* Case 3 - only the prevous block is free
-    *        here we remove from the free list
-    *        and make a new block with combined size of
-    *        current block and previous block
-    */  
-    else if (!prev_alloc && next_alloc) {               
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        bp = PREV_BLKP(bp);
-        removeBlock(bp);
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
-        insertBlock(bp);
-        return bp;
+    else if (GET_SIZE(HDRP(bp)) <= TCACHE_MAX && !(GET(HDRP(bp)) & GROWN)) {
+        i = SLAB_CLASSES + GET_SIZE(HDRP(bp)) / DSIZE;
     }
-    /* Case 4 - both next and previous blocks are free
-    *        here we remove both next and previous blocks
-    *        from the free list and make a new block with a combined
-    *        size of previous, current and next blocks
-    */ 
-    else  {                
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        removeBlock(PREV_BLKP(bp));
-        removeBlock(NEXT_BLKP(bp));
-        bp = PREV_BLKP(bp);
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
-        insertBlock(bp);
-        return bp;
+    else {
+        /* too big, or the grow table of its arena still has it */
+        return 0;
     }
-
+    if (tcache.counts[i] >= TCACHE_COUNT) {
+        return 0;
+    }
+    *(char **)bp = tcache.bins[i];
+    tcache.bins[i] = bp;
+    tcache.counts[i]++;
+    return 1;
 }
 
-/*insert a block into the free list*/
-static void insertBlock(void *bp)
+/*
+ * tcache_put_sized - tcache_put for mm_free_sized, size (at least
+ *      SLAB_MAX) is what bp was asked for. That is never a slab object and
+ *      the bin follows from size, the page map isn't looked at. A block
+ *      with a tail too small to split off goes in the bin of what it was
+ *      asked for and its next owner gets the rest. Like tcache_put we
+ *      leave GROWN blocks alone, only the arena can drop them from its
+ *      grow table.
+ */
+static int tcache_put_sized(void *bp, size_t size)
 {
-    if(bp == NULL) {
-        return;
+    int i;
+
+    if (!tcache_ready() || size > TCACHE_MAX - OVERHEAD || (GET(HDRP(bp)) & GROWN)) {
+        return 0;
     }
-    /* when we insert a free block into the free list we insert
-     * it at the front of the list and
-            make the new front->next point to old front
-            make old front->prev point to new front
-            make the new front->prev point to NULL
-            make the start of the free list point to new front */
-    NEXT_FREE(bp) = free_listp;
-    PREV_FREE(free_listp) = bp;
-    PREV_FREE(bp) = NULL;
-    free_listp = bp;
+    i = SLAB_CLASSES + adjust_and_align(size) / DSIZE;
+    if (tcache.counts[i] >= TCACHE_COUNT) {
+        return 0;
+    }
+    *(char **)bp = tcache.bins[i];
+    tcache.bins[i] = bp;
+    tcache.counts[i]++;
+    return 1;
 }
 
+/* heap_page - index of the heap page bp is on in the page and arena maps */
+static inline size_t heap_page(void *bp)
+{
+    return ((size_t)bp >> SLAB_SHIFT) - ((size_t)mem_heap_lo() >> SLAB_SHIFT);
+}
 
-/*remove block from the free listt*/
-static void removeBlock(void *bp)
+/* arena_of - the arena that owns the block or tiny object bp */
+static inline arena_t *arena_of(void *bp)
 {
-    /* when removing from the list we have two cases:
-     *  1) we are removing from the front of the list
-                in this case we make the start of the list skip
-                the block thats about to be removed and point to
-                the next block in the list
-     *  2) we're not removing from the front of the list
-                in this case we "cross the wires" so to speak and
-                skip over the block that's about to be deleted.
-                If we have a prev, curr and next pointer we make
-                prev point to next and next point to prev so we skip
-                over our curr pointer.
-    */
-    //case 1
-    if(!PREV_FREE(bp)) {
-        free_listp = NEXT_FREE(bp);
-    }
-    //case 2
-    else {
-        NEXT_FREE(PREV_FREE(bp)) = NEXT_FREE(bp);
+    return &arenas[arena_map[heap_page(bp)]];
+}
+
+/* my_arena - the arena the calling thread allocates from */
+static inline arena_t *my_arena(void)
+{
+    if (!tcache.registered) {
+        tcache_ready();
     }
-    PREV_FREE(NEXT_FREE(bp)) = PREV_FREE(bp);
+    return &arenas[tcache.arena_no % num_arenas];
 }
 
+/*
+ * push_remote_free - put bp on the remote free queue of its arena a
+ *      Lock free, the block is still allocated as far as a knows and its
+ *      first word links it to the rest of the queue.
+ */
+static void push_remote_free(arena_t *a, char *bp)
+{
+    char *head = __atomic_load_n(&a->remote_frees, __ATOMIC_RELAXED);
 
-static void printblock(void *bp) {
-    size_t hsize, halloc, fsize, falloc;
+    do {
+        *(char **)bp = head;
+    } while (!__atomic_compare_exchange_n(&a->remote_frees, &head, bp, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * drain_remote_frees - free everything on the current arena's remote free
+ *      queue, its lock is held
+ */
+static void drain_remote_frees(void)
+{
+    char *bp = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    char *next;
 
+    while (bp != NULL) {
+        next = *(char **)bp;
+        do_free(bp);
+        bp = next;
+    }
+}
 
-    hsize = GET_SIZE(HDRP(bp));
-    halloc = GET_ALLOC(HDRP(bp));  
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));  
+/*
+ * at_heap_end - is bp the last block of the heap, or the last but a free block
+ *      Only then can extend_heap grow the heap right behind it.
+ */
+static int at_heap_end(char *bp)
+{
+    char *next = NEXT_BLKP(bp);
+    int at_end;
 
-    if (hsize == 0) {
-        printf("%p: end of heap\n", bp);
-        return;
+    if (!GET_ALLOC(HDRP(next))) {
+        next = NEXT_BLKP(next);
+    }
+    if (GET_SIZE(HDRP(next)) != 0 || next != arena->brk) {
+        return 0;
     }
+    pthread_mutex_lock(&sbrk_lock);
+    at_end = (arena->brk == (char *)mem_heap_hi() + 1);
+    pthread_mutex_unlock(&sbrk_lock);
+    return at_end;
+}
 
-    printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp, 
-      hsize, (halloc ? 'a' : 'f'), 
-      fsize, (falloc ? 'a' : 'f'));
+/* arena_reset - an arena with no memory and empty lists */
+static void arena_reset(arena_t *a)
+{
+    int i;
+
+    a->segs = NULL;
+    a->remote_frees = NULL;
+    a->brk = NULL;
+    for (i = 0; i < NUM_CLASSES; i++) {
+        a->seg_lists[i] = NULL;
+    }
+#if USE_TLSF
+    a->fl_bitmap = 0;
+    for (i = 0; i < FL_COUNT; i++) {
+        a->sl_bitmap[i] = 0;
+    }
+#else
+    a->tree_root = NULL;
+    for (i = 0; i < NUM_CLASSES; i++) {
+        a->rovers[i] = NULL;
+    }
+#endif
+    for (i = 0; i < SLAB_CLASSES; i++) {
+        a->slab_lists[i] = NULL;
+    }
+    for (i = 0; i < QUICK_BINS; i++) {
+        a->quick[i] = NULL;
+        a->quick_len[i] = 0;
+    }
+    a->quick_total = 0;
+    a->quiet = 0;
+    a->placed = 0;
+    a->freed = 0;
+    a->req = 0;
+    a->step = grow_min;
+    a->heap = 0;
+    a->fresh = NULL;
+    a->ntouched = TOUCH_LOG + 1;
+    memset(a->grows, 0, sizeof(a->grows));
+    memset(&a->counts, 0, sizeof(a->counts));
 }
 
+/* lock_arenas/unlock_arenas - take or drop the locks of all arenas, always in the same order */
+static void lock_arenas(void)
+{
+    int i;
+
+    for (i = 0; i < MAX_ARENAS; i++) {
+        pthread_mutex_lock(&arenas[i].lock);
+    }
+}
 
-static void checkblock(void *bp) {
+static void unlock_arenas(void)
+{
+    int i;
 
-    if ((int)bp % DSIZE)
-        printf("Error: %p is not doubleword aligned\n", bp);
-    if (GET(HDRP(bp)) != GET(FTRP(bp)))
-        printf("Error: header does not match footer\n");
+    for (i = MAX_ARENAS - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&arenas[i].lock);
+    }
 }
 
 static size_t adjust_and_align(size_t size) {
     size_t asize;
-    if (size <= DSIZE){
-        asize =  DSIZE + OVERHEAD;
+    if (size + OVERHEAD <= MIN_BLOCK){
+        asize = MIN_BLOCK;
     }
 	else{
         asize = DSIZE * ((size + OVERHEAD + (DSIZE - 1)) / DSIZE);
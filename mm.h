@@ -5,6 +5,149 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * nmemb * size bytes, all zero, NULL if that overflows. Memory the heap
+ * never handed out before is zero already and doesn't get cleared again.
+ */
+extern void *mm_calloc(size_t nmemb, size_t size);
+
+/*
+ * What a block can really hold, at least what was asked for (0 for NULL).
+ * All of it can be used, a buffer that grows within it needs no realloc.
+ * mm_malloc_sized is mm_malloc that puts that in *actual.
+ */
+extern size_t mm_usable_size(void *ptr);
+extern void *mm_malloc_sized(size_t size, size_t *actual);
+
+/*
+ * Sized free, size is what the block was last asked for with (malloc or
+ * realloc). Build mm.c with -DCHECK_SIZED=1 to have the size checked.
+ */
+extern void mm_free_sized(void *ptr, size_t size);
+
+/*
+ * A block whose payload starts at a multiple of alignment (a power of
+ * two, NULL otherwise). Free it with mm_free like any other block.
+ */
+extern void *mm_memalign(size_t alignment, size_t size);
+
+/*
+ * Batches. mm_malloc_batch puts n blocks of size bytes in out[] and
+ * returns how many it got (fewer than n only when out of memory).
+ * mm_free_batch frees n blocks and sorts ptrs by address while doing so,
+ * blocks next to each other in the heap are coalesced in one go.
+ */
+extern int mm_malloc_batch(size_t size, int n, void **out);
+extern void mm_free_batch(void **ptrs, int n);
+
+/*
+ * Regions, for objects that all die at the same time. mm_region_alloc
+ * hands out size bytes by bumping a pointer in chunks the region gets
+ * from mm_malloc (chunk bytes each, 0 for the default). Objects are never
+ * freed one by one, mm_region_reset gives all of them up at once and
+ * keeps one chunk for what comes next, mm_region_destroy frees it all.
+ * A region may only be used by one thread at a time.
+ */
+typedef struct mm_region mm_region_t;
+
+extern mm_region_t *mm_region_create(size_t chunk);
+extern void *mm_region_alloc(mm_region_t *r, size_t size);
+extern void mm_region_reset(mm_region_t *r);
+extern void mm_region_destroy(mm_region_t *r);
+
+/*
+ * Pools of objects of one size, aligned to align (a power of two, 0 for
+ * the default). The pool gets chunks from mm_malloc and keeps free
+ * objects on a stack, get and put just pop and push. Objects only go back
+ * to the heap with mm_pool_destroy. A pool may only be used by one thread
+ * at a time.
+ */
+typedef struct mm_pool mm_pool_t;
+
+extern mm_pool_t *mm_pool_create(size_t size, size_t align);
+extern void *mm_pool_get(mm_pool_t *p);
+extern void mm_pool_put(mm_pool_t *p, void *obj);
+extern void mm_pool_destroy(mm_pool_t *p);
+
+/*
+ * Movable blocks. mm_halloc returns a handle (0 if out of memory), not a
+ * pointer, the block lives in a heap of its own that a compactor keeps
+ * sliding down and shrinking a little on every call. mm_hlock pins the
+ * block and says where it is, mm_hunlock lets it move again.
+ * mm_hcompact lets the compactor do up to bytes of work (0 for all it
+ * can) and returns 1 if there is more to do.
+ */
+typedef size_t mm_handle_t;
+
+extern mm_handle_t mm_halloc(size_t size);
+extern void *mm_hlock(mm_handle_t h);
+extern void mm_hunlock(mm_handle_t h);
+extern void mm_hfree(mm_handle_t h);
+extern int mm_hcompact(size_t bytes);
+
+/* 
+ * Placement policies for mm_set_policy. MM_GOOD_FIT stops looking after
+ * max_probes blocks or at the first block with at most max_slack bytes
+ * to spare, whichever comes first (see mm_set_good_fit).
+ */
+#define MM_FIRST_FIT 0
+#define MM_NEXT_FIT  1
+#define MM_BEST_FIT  2
+#define MM_GOOD_FIT  3
+
+extern int mm_set_policy(int policy);
+extern void mm_set_good_fit(int max_probes, size_t max_slack);
+
+/*
+ * Number of independent arenas (1 up to 8), each with its own lock.
+ * Threads get an arena round robin. Takes effect at the next mm_init.
+ */
+extern int mm_set_arenas(int n);
+
+/*
+ * Deferred coalescing: small freed blocks wait on quick lists of their
+ * exact size instead of being merged with their neighbours right away.
+ */
+extern void mm_set_deferred(int on);
+
+/*
+ * Requests of at least this many bytes get an mmap region of their own
+ * instead of a block in the heap (128 KB by default, 0 turns it off).
+ */
+extern void mm_set_mmap_threshold(size_t bytes);
+
+/*
+ * The heap grows by min up to max bytes at a time (4 KB and 64 KB by
+ * default). The step doubles while the bytes malloced outnumber the bytes
+ * freed by ramp to one (4), and then holds a few of the recent requests,
+ * it halves otherwise. min = max grows by the same step every time.
+ */
+extern void mm_set_growth(size_t min, size_t max, unsigned ramp);
+
+/* Counters since the last mm_init */
+typedef struct {
+    size_t splits;        /* free blocks split by malloc */
+    size_t merges;        /* free blocks merged with a neighbour */
+    size_t quick_hits;    /* mallocs served from a quick list */
+    size_t quick_flushes; /* times the quick lists were coalesced */
+    size_t moves;         /* reallocs that had to copy the block */
+    size_t trimmed;       /* bytes the heap shrank by at its end */
+    size_t released;      /* bytes of free blocks given back with madvise */
+    size_t zeroed;        /* bytes mm_calloc had to clear */
+    size_t extends;       /* times the heap was extended */
+} mm_counts_t;
+
+extern void mm_get_counts(mm_counts_t *counts);
+
+/*
+ * Heap checks, both print what is wrong and return 0 if anything is.
+ * mm_check looks at everything in time linear in the number of blocks.
+ * mm_check_touched only looks at the blocks malloc and free changed since
+ * its last call and is cheap enough to run after every request (the first
+ * call looks at everything).
+ */
+extern int mm_check(void);
+extern int mm_check_touched(void);
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 